@@ -0,0 +1,651 @@
+#include "util.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+//---------------------------------------------------------------------------
+// C++ memory safety benchmarks
+// (c) 2023 Thomas Neumann
+// SPDX-License-Identifier: MIT
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+namespace {
+//---------------------------------------------------------------------------
+/// A simple thread pool that runs a function on all workers
+class ThreadPool {
+   /// The workers
+   vector<thread> workers;
+   /// The synchronization
+   mutex m;
+   condition_variable cv, done;
+   /// The current job
+   function<void(unsigned)> job;
+   /// The job generation
+   unsigned generation = 0;
+   /// The number of workers that still work on the current job
+   unsigned running = 0;
+   /// Shutting down?
+   bool shutdown = false;
+
+   public:
+   /// Constructor
+   explicit ThreadPool(unsigned threads) {
+      for (unsigned index = 0; index != threads; ++index)
+         workers.emplace_back([this, index]() {
+            unsigned seen = 0;
+            while (true) {
+               function<void(unsigned)> current;
+               {
+                  unique_lock lock(m);
+                  cv.wait(lock, [&]() { return shutdown || (generation != seen); });
+                  if (shutdown) return;
+                  seen = generation;
+                  current = job;
+               }
+               current(index);
+               unique_lock lock(m);
+               if (!--running) done.notify_all();
+            }
+         });
+   }
+   /// Destructor
+   ~ThreadPool() {
+      {
+         unique_lock lock(m);
+         shutdown = true;
+      }
+      cv.notify_all();
+      for (auto& w : workers) w.join();
+   }
+
+   /// The number of workers
+   unsigned size() const { return workers.size(); }
+   /// Run a function on all workers and wait for completion
+   void run(function<void(unsigned)> f) {
+      unique_lock lock(m);
+      job = move(f);
+      running = workers.size();
+      ++generation;
+      cv.notify_all();
+      done.wait(lock, [&]() { return !running; });
+   }
+};
+//---------------------------------------------------------------------------
+/// Measure the runtime of a function in milliseconds
+template <class F>
+double measure(F&& f) {
+   auto start = chrono::steady_clock::now();
+   f();
+   auto stop = chrono::steady_clock::now();
+   return chrono::duration<double, milli>(stop - start).count();
+}
+//---------------------------------------------------------------------------
+/// Prevent the compiler from optimizing away a value
+template <class T>
+void doNotOptimize(const T& value) {
+   asm volatile("" : : "r,m"(value) : "memory");
+}
+//---------------------------------------------------------------------------
+/// Build a random string
+ms_string randomString(unsigned len) {
+   ms_string result;
+   result.resize(len);
+   mt19937 rng(42);
+   for (auto& c : result.parallel()) c = 'a' + (rng() % 26);
+   return result;
+}
+//---------------------------------------------------------------------------
+/// Parallel algorithms over a frozen string compared to checked iterators
+void benchParallel(unsigned threads) {
+   constexpr unsigned len = 1 << 22;
+   ThreadPool pool(threads);
+   ms_string s = randomString(len);
+   unsigned long sum1 = 0, sum2 = 0;
+
+   printf("parallel: %u characters, %u threads\n", len, threads);
+   printf("transform checked iterators: %.1fms\n", measure([&]() {
+             for (auto iter = s.begin(), limit = s.end(); iter != limit; ++iter) *iter = *iter - 'a' + 'A';
+          }));
+   printf("transform parallel section:  %.1fms\n", measure([&]() {
+             auto section = s.parallel();
+             pool.run([&](unsigned worker) {
+                for (auto& c : section.chunk(worker, pool.size())) c = c - 'A' + 'a';
+             });
+          }));
+   printf("reduce checked iterators:    %.1fms\n", measure([&]() {
+             for (auto iter = s.begin(), limit = s.end(); iter != limit; ++iter) sum1 += *iter;
+          }));
+   printf("reduce parallel section:     %.1fms\n", measure([&]() {
+             auto section = s.parallel();
+             vector<unsigned long> sums(pool.size());
+             pool.run([&](unsigned worker) {
+                unsigned long local = 0;
+                for (auto c : section.chunk(worker, pool.size())) local += c;
+                sums[worker] = local;
+             });
+             for (auto v : sums) sum2 += v;
+          }));
+   if (sum1 != sum2) printf("checksum mismatch!\n");
+
+   // Checked iterators are copied a lot during sorting, use a smaller input
+   s.resize(len / 16);
+   ms_string s2 = s;
+   printf("sort checked iterators:      %.1fms\n", measure([&]() { sort(s.begin(), s.end()); }));
+   printf("sort parallel section:       %.1fms\n", measure([&]() {
+             auto section = s2.parallel();
+             pool.run([&](unsigned worker) {
+                auto chunk = section.chunk(worker, pool.size());
+                sort(chunk.begin(), chunk.end());
+             });
+             // Merge the sorted chunks
+             vector<char*> bounds;
+             for (unsigned index = 0; index != pool.size(); ++index) bounds.push_back(section.chunk(index, pool.size()).data());
+             bounds.push_back(section.end());
+             while (bounds.size() > 2) {
+                vector<char*> next;
+                for (unsigned index = 0; index + 2 < bounds.size(); index += 2) {
+                   inplace_merge(bounds[index], bounds[index + 1], bounds[index + 2]);
+                   next.push_back(bounds[index]);
+                }
+                if (!(bounds.size() & 1)) next.push_back(bounds[bounds.size() - 2]);
+                next.push_back(bounds.back());
+                bounds = move(next);
+             }
+          }));
+   if (!equal(s.begin(), s.end(), s2.begin(), s2.end())) printf("sort mismatch!\n");
+}
+//---------------------------------------------------------------------------
+/// Sequential loops over a string with per-element checks compared to for_each
+void benchLoop(unsigned /*threads*/) {
+   constexpr unsigned len = 1 << 22;
+   ms_string s = randomString(len);
+   unsigned long sum1 = 0, sum2 = 0;
+
+   printf("loop: %u characters\n", len);
+   printf("range-for:   %.1fms\n", measure([&]() {
+             for (char c : s) sum1 += c;
+          }));
+   printf("for_each:    %.1fms\n", measure([&]() {
+             s.for_each([&](char c) { sum2 += c; });
+          }));
+   if (sum1 != sum2) printf("checksum mismatch!\n");
+}
+//---------------------------------------------------------------------------
+/// Smart pointers compared to their std counterparts
+void benchSmartPtr(unsigned /*threads*/) {
+   constexpr unsigned count = 1 << 20;
+   struct Node {
+      unsigned long value;
+   };
+   unsigned long sum1 = 0, sum2 = 0;
+
+   printf("smartptr: %u objects\n", count);
+   printf("std::unique_ptr create/destroy:  %.1fms\n", measure([&]() {
+             for (unsigned index = 0; index != count; ++index) {
+                auto p = make_unique<Node>(index);
+                doNotOptimize(p.get());
+                sum1 += p->value;
+             }
+          }));
+   printf("ms_unique_ptr create/destroy:    %.1fms\n", measure([&]() {
+             for (unsigned index = 0; index != count; ++index) {
+                auto p = make_ms_unique<Node>(index);
+                doNotOptimize(p.get());
+                sum2 += p->value;
+             }
+          }));
+
+   vector<unique_ptr<Node>> stdUnique;
+   vector<ms_unique_ptr<Node>> msUnique;
+   for (unsigned index = 0; index != count; ++index) {
+      stdUnique.push_back(make_unique<Node>(index));
+      msUnique.push_back(make_ms_unique<Node>(index));
+   }
+   printf("std::unique_ptr access:          %.1fms\n", measure([&]() {
+             for (auto& p : stdUnique) sum1 += p->value;
+          }));
+   printf("ms_unique_ptr access:            %.1fms\n", measure([&]() {
+             for (auto& p : msUnique) sum2 += p->value;
+          }));
+
+   printf("std::shared_ptr create/destroy:  %.1fms\n", measure([&]() {
+             for (unsigned index = 0; index != count; ++index) {
+                auto p = make_shared<Node>(index);
+                auto p2 = p;
+                sum1 += p2->value;
+             }
+          }));
+   printf("ms_shared_ptr create/destroy:    %.1fms\n", measure([&]() {
+             for (unsigned index = 0; index != count; ++index) {
+                auto p = make_ms_shared<Node>(index);
+                auto p2 = p;
+                sum2 += p2->value;
+             }
+          }));
+   printf("std::weak_ptr lock:              %.1fms\n", measure([&]() {
+             auto p = make_shared<Node>(1);
+             weak_ptr<Node> w = p;
+             for (unsigned index = 0; index != count; ++index) sum1 += w.lock()->value;
+          }));
+   printf("ms_weak_ptr lock:                %.1fms\n", measure([&]() {
+             auto p = make_ms_shared<Node>(1);
+             ms_weak_ptr<Node> w = p;
+             for (unsigned index = 0; index != count; ++index) sum2 += w.lock()->value;
+          }));
+   if (sum1 != sum2) printf("checksum mismatch!\n");
+}
+//---------------------------------------------------------------------------
+/// Hash map operations compared to std::unordered_map
+void benchHashMap(unsigned /*threads*/) {
+   constexpr unsigned count = 1 << 20;
+   vector<unsigned long> keys(count);
+   mt19937_64 rng(42);
+   for (auto& k : keys) k = rng();
+   unsigned long sum1 = 0, sum2 = 0;
+
+   unordered_map<unsigned long, unsigned long> stdMap;
+   ms_hash_map<unsigned long, unsigned long> msMap;
+   printf("hashmap: %u elements\n", count);
+   printf("std::unordered_map insert:  %.1fms\n", measure([&]() {
+             for (auto k : keys) stdMap.try_emplace(k, k);
+          }));
+   printf("ms_hash_map insert:         %.1fms\n", measure([&]() {
+             for (auto k : keys) msMap.insert_or_assign(k, k);
+          }));
+   printf("std::unordered_map hit:     %.1fms\n", measure([&]() {
+             for (auto k : keys) sum1 += stdMap.find(k)->second;
+          }));
+   printf("ms_hash_map hit:            %.1fms\n", measure([&]() {
+             for (auto k : keys) msMap.visit(k, [&](unsigned long v) { sum2 += v; });
+          }));
+   printf("ms_hash_map hit iterator:   %.1fms\n", measure([&]() {
+             unsigned long sum = 0;
+             for (auto k : keys) sum += (*msMap.find(k)).second;
+             doNotOptimize(sum);
+          }));
+   printf("std::unordered_map miss:    %.1fms\n", measure([&]() {
+             for (auto k : keys) sum1 += stdMap.count(k + 1);
+          }));
+   printf("ms_hash_map miss:           %.1fms\n", measure([&]() {
+             for (auto k : keys) sum2 += msMap.count(k + 1);
+          }));
+   printf("std::unordered_map erase:   %.1fms\n", measure([&]() {
+             for (auto k : keys) sum1 += stdMap.erase(k);
+          }));
+   printf("ms_hash_map erase:          %.1fms\n", measure([&]() {
+             for (auto k : keys) sum2 += msMap.erase(k);
+          }));
+   if (sum1 != sum2) printf("checksum mismatch!\n");
+}
+//---------------------------------------------------------------------------
+/// Line scanning of a memory mapped file compared to std::ifstream
+void benchLines(unsigned /*threads*/) {
+   constexpr unsigned count = 1 << 21;
+   char path[] = "/tmp/msbenchXXXXXX";
+   int fd = mkstemp(path);
+   if (fd < 0) {
+      printf("unable to create a temporary file\n");
+      return;
+   }
+   {
+      mt19937 rng(42);
+      string data;
+      for (unsigned index = 0; index != count; ++index) {
+         unsigned len = rng() % 80;
+         for (unsigned index2 = 0; index2 != len; ++index2) data += 'a' + (rng() % 26);
+         data += '\n';
+      }
+      if (write(fd, data.data(), data.size()) != static_cast<ssize_t>(data.size())) printf("write failed!\n");
+      close(fd);
+      printf("lines: %u lines, %lu bytes\n", count, data.size());
+   }
+   unsigned long lines1 = 0, lines2 = 0, lines3 = 0, lines4 = 0, lines5 = 0, lines6 = 0;
+   unsigned long sum1 = 0, sum2 = 0, sum3 = 0, sum4 = 0, sum5 = 0, sum6 = 0;
+
+   printf("std::getline + copy:          %.1fms\n", measure([&]() {
+             ifstream in(path);
+             string buffer;
+             ms_string line;
+             while (getline(in, buffer)) {
+                line.clear();
+                line.append(buffer.data(), buffer.size());
+                ++lines1;
+                sum1 += line.size();
+             }
+          }));
+   printf("getline into ms_string:       %.1fms\n", measure([&]() {
+             ifstream in(path);
+             ms_string line;
+             while (getline(in, line)) {
+                ++lines5;
+                sum5 += line.size();
+             }
+          }));
+   printf("ms_read_file + ms_tokenizer:  %.1fms\n", measure([&]() {
+             ms_string data;
+             ms_read_file(path, data);
+             ms_tokenizer tokenizer(data.view(), '\n');
+             ms_token_batch batch;
+             while (tokenizer.next(batch)) {
+                lines6 += batch.size();
+                for (unsigned index = 0; index != batch.size(); ++index) sum6 += batch[index].size();
+             }
+          }));
+   printf("ms_mapped_file views:         %.1fms\n", measure([&]() {
+             ms_mapped_file file(path);
+             auto data = file.view();
+             for (ms_string_view::size_type pos = 0, limit = data.size(); pos < limit;) {
+                auto end = data.find('\n', pos);
+                if (end == ms_string_view::npos) end = limit;
+                auto line = data.substr(pos, end - pos);
+                ++lines2;
+                sum2 += line.size();
+                pos = end + 1;
+             }
+          }));
+   printf("ms_mapped_file span:          %.1fms\n", measure([&]() {
+             ms_mapped_file file(path);
+             auto data = file.view();
+             auto span = data.span();
+             for (auto iter = span.begin(), limit = span.end(); iter < limit;) {
+                auto end = static_cast<const char*>(memchr(&*iter, '\n', limit - iter));
+                auto len = end ? (end - &*iter) : (limit - iter);
+                ++lines3;
+                sum3 += len;
+                iter += len + 1;
+             }
+          }));
+   printf("ms_tokenizer batches:         %.1fms\n", measure([&]() {
+             ms_mapped_file file(path);
+             ms_tokenizer tokenizer(file.view(), '\n');
+             ms_token_batch batch;
+             while (tokenizer.next(batch)) {
+                lines4 += batch.size();
+                for (unsigned index = 0; index != batch.size(); ++index) sum4 += batch[index].size();
+             }
+          }));
+   unlink(path);
+   if ((lines1 != lines2) || (sum1 != sum2) || (lines1 != lines3) || (sum1 != sum3) || (lines1 != lines4) || (sum1 != sum4) || (lines1 != lines5) || (sum1 != sum5) || (lines1 != lines6) || (sum1 != sum6)) printf("checksum mismatch!\n");
+}
+//---------------------------------------------------------------------------
+/// Contended updates and read-mostly workloads on locked objects
+void benchLocked(unsigned threads) {
+   constexpr unsigned count = 1 << 18;
+   ThreadPool pool(threads);
+   printf("locked: %u operations per thread, %u threads\n", count, threads);
+
+   auto increments = [&](auto& value) {
+      return measure([&]() {
+         pool.run([&](unsigned) {
+            for (unsigned index = 0; index != count; ++index) value.apply([](unsigned long& v) { ++v; });
+         });
+      });
+   };
+   locked<unsigned long> mutexCounter;
+   adaptive_locked<unsigned long> adaptiveCounter;
+   rw_locked<unsigned long> rwCounter;
+   printf("increment locked:            %.1fms\n", increments(mutexCounter));
+   printf("increment adaptive_locked:   %.1fms\n", increments(adaptiveCounter));
+   printf("increment rw_locked:         %.1fms\n", increments(rwCounter));
+   unsigned long expected = static_cast<unsigned long>(count) * pool.size(), sum = 0;
+   mutexCounter.apply([&](unsigned long v) { sum += v; });
+   adaptiveCounter.apply([&](unsigned long v) { sum += v; });
+   rwCounter.apply([&](unsigned long v) { sum += v; });
+   if (sum != 3 * expected) printf("checksum mismatch!\n");
+
+   // Read-mostly: one write per 32 reads of a small vector
+   auto readMostly = [&](auto& value, auto read) {
+      return measure([&]() {
+         pool.run([&](unsigned worker) {
+            unsigned long local = 0;
+            for (unsigned index = 0; index != count; ++index) {
+               if (!(index & 31))
+                  value.apply([&](vector<unsigned>& v) { ++v[(index + worker) % v.size()]; });
+               else
+                  local += read(value);
+            }
+            doNotOptimize(local);
+         });
+      });
+   };
+   auto sumVector = [](const vector<unsigned>& v) {
+      unsigned long s = 0;
+      for (auto e : v) s += e;
+      return s;
+   };
+   locked<vector<unsigned>> mutexVector(64);
+   adaptive_locked<vector<unsigned>> adaptiveVector(64);
+   rw_locked<vector<unsigned>> rwVector(64);
+   printf("read-mostly locked:          %.1fms\n", readMostly(mutexVector, [&](auto& l) { return l.apply(sumVector); }));
+   printf("read-mostly adaptive_locked: %.1fms\n", readMostly(adaptiveVector, [&](auto& l) { return l.apply(sumVector); }));
+   printf("read-mostly rw_locked:       %.1fms\n", readMostly(rwVector, [&](auto& l) { return l.apply_shared(sumVector); }));
+}
+//---------------------------------------------------------------------------
+/// Readers validating shared iterators while a writer keeps adding and removing shared objects
+void benchValidate(unsigned threads) {
+   constexpr unsigned count = 1 << 22;
+   printf("validate: %u reads per thread, up to %u threads\n", count, threads);
+
+   ms_string s = randomString(64);
+   s.share();
+   for (unsigned readers = 1; readers <= threads; readers = (readers < threads) ? min(readers * 2, threads) : threads + 1) {
+      ThreadPool pool(readers);
+      atomic<bool> stop{false};
+      unsigned long writes = 0;
+
+      // The writer rehashes the shared index and retires objects all the time
+      thread writer([&]() {
+         vector<ms_string::const_iterator> iters;
+         while (!stop.load(memory_order_relaxed)) {
+            for (unsigned index = 0; index != 256; ++index) iters.push_back(s.cbegin() + (index % s.size()));
+            writes += iters.size();
+            iters.clear();
+         }
+      });
+      double time = measure([&]() {
+         pool.run([&](unsigned worker) {
+            auto iter = s.cbegin() + worker % s.size();
+            unsigned long sum = 0;
+            for (unsigned index = 0; index != count; ++index) sum += *iter;
+            doNotOptimize(sum);
+         });
+      });
+      stop = true;
+      writer.join();
+      printf("%3u readers: %7.1fms, %.1fM reads/s, %lu writes\n", readers, time, readers * (count / 1000.0) / time, writes);
+   }
+}
+//---------------------------------------------------------------------------
+/// Many threads registering dependencies on the same shared object
+void benchRegister(unsigned threads) {
+   constexpr unsigned count = 1 << 18;
+   printf("register: %u iterators per thread, up to %u threads\n", count, threads);
+
+   ms_string s = randomString(64);
+   s.share();
+   for (unsigned workers = 1; workers <= threads; workers = (workers < threads) ? min(workers * 2, threads) : threads + 1) {
+      ThreadPool pool(workers);
+      double time = measure([&]() {
+         pool.run([&](unsigned worker) {
+            unsigned long sum = 0;
+            for (unsigned index = 0; index != count; ++index) {
+               auto iter = s.cbegin() + ((index + worker) % s.size());
+               sum += *iter;
+            }
+            doNotOptimize(sum);
+         });
+      });
+      printf("%3u threads: %7.1fms, %.1fM registrations/s\n", workers, time, workers * (count / 1000.0) / time);
+   }
+}
+//---------------------------------------------------------------------------
+/// Destroying a string with a huge number of views, serially and in parallel
+void benchFanIn(unsigned threads) {
+   constexpr unsigned count = 1 << 21;
+   printf("fanin: %u views, %u threads\n", count, threads);
+
+   auto destroy = [&]() {
+      auto s = make_unique<ms_string>(randomString(64));
+      vector<ms_string_view> views;
+      views.reserve(count);
+      for (unsigned index = 0; index != count; ++index) views.push_back(s->view());
+      return measure([&]() { s.reset(); });
+   };
+   printf("destroy serial:   %.1fms\n", destroy());
+   memorysafety::set_parallel_invalidation(1 << 16, threads);
+   printf("destroy parallel: %.1fms\n", destroy());
+   memorysafety::set_parallel_invalidation(0, 0);
+}
+//---------------------------------------------------------------------------
+/// Submitting small tasks to the work-stealing executor, with and without checking the captured references
+void benchTasks(unsigned threads) {
+   constexpr unsigned count = 1 << 18;
+   printf("tasks: %u tasks, %u threads\n", count, threads);
+
+   ms_string request = randomString(64);
+   ms_executor executor(threads);
+   atomic<unsigned long> sum{0};
+   auto run = [&](bool checked) {
+      double submit = 0;
+      double time = measure([&]() {
+         submit = measure([&]() {
+            for (unsigned index = 0; index != count; ++index) {
+               auto task = [&request, &sum, index]() { sum.fetch_add(request[index % 64], memory_order_relaxed); };
+               if (checked)
+                  executor.submit(task, request);
+               else
+                  executor.submit(task);
+            }
+         });
+         executor.wait();
+      });
+      printf("%-10s submit %7.1fms, %.1fM tasks/s, total %7.1fms\n", checked ? "checked:" : "unchecked:", submit, count / 1000.0 / submit, time);
+   };
+   run(false);
+   run(true);
+   doNotOptimize(sum.load());
+}
+//---------------------------------------------------------------------------
+/// Invoking and constructing callbacks that capture two references and an index
+void benchFunction(unsigned /*threads*/) {
+   constexpr unsigned count = 1 << 22;
+   constexpr unsigned slots = 16;
+   printf("function: %u calls\n", count);
+
+   ms_string request = randomString(64);
+   unsigned long offset = 1;
+   auto make = [&](unsigned index) { return [&request, &offset, index]() { return request.data()[index % 64] + offset; }; };
+
+   // Call a set of functions round robin
+   auto invoke = [&](const char* name, auto& functions) {
+      unsigned long sum = 0;
+      double time = measure([&]() {
+         for (unsigned index = 0; index != count; ++index) sum += functions[index % slots]();
+      });
+      doNotOptimize(sum);
+      printf("invoke %-20s %7.1fms\n", name, time);
+   };
+   // Create, call, and destroy a function per iteration
+   auto construct = [&]<class F>(const char* name, F create) {
+      unsigned long sum = 0;
+      double time = measure([&]() {
+         for (unsigned index = 0; index != count; ++index) {
+            auto f = create(index);
+            doNotOptimize(f);
+            sum += f();
+         }
+      });
+      doNotOptimize(sum);
+      printf("construct %-17s %7.1fms\n", name, time);
+   };
+
+   {
+      vector<function<unsigned long()>> functions;
+      for (unsigned index = 0; index != slots; ++index) functions.emplace_back(make(index));
+      invoke("std::function", functions);
+   }
+#ifdef __cpp_lib_move_only_function
+   {
+      vector<move_only_function<unsigned long()>> functions;
+      for (unsigned index = 0; index != slots; ++index) functions.emplace_back(make(index));
+      invoke("move_only_function", functions);
+   }
+#endif
+   {
+      vector<ms_function<unsigned long()>> functions;
+      for (unsigned index = 0; index != slots; ++index) functions.emplace_back(make(index));
+      invoke("ms_function", functions);
+   }
+   {
+      vector<ms_function<unsigned long()>> functions;
+      for (unsigned index = 0; index != slots; ++index) functions.emplace_back(make(index), request);
+      invoke("ms_function checked", functions);
+   }
+
+   construct("std::function", [&](unsigned index) { return function<unsigned long()>(make(index)); });
+#ifdef __cpp_lib_move_only_function
+   construct("move_only_function", [&](unsigned index) { return move_only_function<unsigned long()>(make(index)); });
+#endif
+   construct("ms_function", [&](unsigned index) { return ms_function<unsigned long()>(make(index)); });
+   construct("ms_function checked", [&](unsigned index) { return ms_function<unsigned long()>(make(index), request); });
+}
+//---------------------------------------------------------------------------
+/// A benchmark
+struct Benchmark {
+   /// The name
+   const char* name;
+   /// The benchmark function
+   void (*run)(unsigned threads);
+};
+//---------------------------------------------------------------------------
+/// All benchmarks
+const Benchmark benchmarks[] = {
+   {"parallel", benchParallel},
+   {"loop", benchLoop},
+   {"smartptr", benchSmartPtr},
+   {"hashmap", benchHashMap},
+   {"lines", benchLines},
+   {"locked", benchLocked},
+   {"validate", benchValidate},
+   {"register", benchRegister},
+   {"fanin", benchFanIn},
+   {"tasks", benchTasks},
+   {"function", benchFunction},
+};
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+int main(int argc, char* argv[]) {
+   if ((argc > 1) && ((strcmp(argv[1], "-h") == 0) || (strcmp(argv[1], "--help") == 0))) {
+      printf("usage: %s [benchmark] [threads]\nbenchmarks:", argv[0]);
+      for (auto& b : benchmarks) printf(" %s", b.name);
+      printf("\n");
+      return 0;
+   }
+   const char* name = (argc > 1) ? argv[1] : nullptr;
+   unsigned threads = (argc > 2) ? atoi(argv[2]) : thread::hardware_concurrency();
+   if (!threads) threads = 1;
+
+   bool found = false;
+   for (auto& b : benchmarks)
+      if ((!name) || (strcmp(name, b.name) == 0)) {
+         b.run(threads);
+         found = true;
+      }
+   if (!found) {
+      fprintf(stderr, "unknown benchmark %s\n", name);
+      return 1;
+   }
+}
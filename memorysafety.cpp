@@ -1,6 +1,19 @@
 #include "memorysafety.hpp"
+#include <atomic>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
+#include <vector>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <linux/membarrier.h>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 //---------------------------------------------------------------------------
 // C++ memory safety runtime
 // (c) 2023 Thomas Neumann
@@ -20,29 +33,638 @@ static void defaultHandler(const void* A) {
 //---------------------------------------------------------------------------
 static constinit ViolationHandler violationHandler = defaultHandler;
 //---------------------------------------------------------------------------
-/// Memory safety logic
+/// A simple spin latch. Runtime calls are short, so spinning is cheaper than parking
+class Latch {
+   /// The state
+   std::atomic<bool> locked{false};
+
+   public:
+   /// Lock
+   void lock() noexcept {
+      while (locked.exchange(true, std::memory_order_acquire)) {
+         for (unsigned spin = 0; locked.load(std::memory_order_relaxed); ++spin) {
+            if (spin >= 64) {
+               std::this_thread::yield();
+            } else {
+#if defined(__x86_64__) || defined(__i386__)
+               __builtin_ia32_pause();
+#endif
+            }
+         }
+      }
+   }
+   /// Unlock
+   void unlock() noexcept { locked.store(false, std::memory_order_release); }
+};
+//---------------------------------------------------------------------------
+/// A filter for the objects of the shared domain. Bits are set when objects enter the shared
+/// domain and are never cleared, a clear bit proves that an object is not shared. This allows
+/// for operating on thread local objects without any synchronization
+class SharedFilter {
+   /// The number of bits (log2)
+   static constexpr unsigned bitsLog = 18;
+   /// The bits
+   std::atomic<unsigned long> bits[(1u << bitsLog) / 64];
+
+   /// Compute the bit position
+   static unsigned slot(const void* A) noexcept { return (reinterpret_cast<unsigned long>(A) * 0x9e3779b97f4a7c15ull) >> (64 - bitsLog); }
+
+   public:
+   /// Might the object be shared?
+   bool mayContain(const void* A) const noexcept {
+      unsigned s = slot(A);
+      return bits[s / 64].load(std::memory_order_relaxed) & (1ul << (s % 64));
+   }
+   /// Remember an object as shared
+   void insert(const void* A) noexcept {
+      unsigned s = slot(A);
+      if (!(bits[s / 64].load(std::memory_order_relaxed) & (1ul << (s % 64)))) bits[s / 64].fetch_or(1ul << (s % 64), std::memory_order_relaxed);
+   }
+};
+//---------------------------------------------------------------------------
+/// The filter of the shared domain
+static constinit SharedFilter sharedFilter;
+//---------------------------------------------------------------------------
+/// Memory for runtime metadata that is placed on the NUMA node of the allocating thread. Memory is organized in aligned
+/// chunks that are bound to one node and hold blocks of one size class, the node of a block is found in the chunk header.
+/// Threads cache free blocks of their current node, so most allocations need no synchronization. Chunks are never
+/// unmapped, freed blocks go back to the pools of their node and are reused for metadata of the same size class
+class NodeMemory {
+   public:
+   /// The maximum number of nodes
+   static constexpr unsigned maxNodes = 64;
+   /// The largest block size, larger allocations use the regular heap
+   static constexpr size_t maxSize = 256;
+
+   private:
+   /// The granularity of size classes
+   static constexpr size_t granularity = 16;
+   /// The number of size classes
+   static constexpr unsigned classes = maxSize / granularity;
+   /// The chunk size
+   static constexpr size_t chunkSize = 2 << 20;
+   /// The number of blocks moved between a thread cache and a pool at once
+   static constexpr unsigned batchSize = 32;
+   /// The number of node queries after which the node of a thread is checked again
+   static constexpr unsigned refreshInterval = 64;
+
+   /// The header of a chunk
+   struct alignas(64) Chunk {
+      /// The node
+      unsigned node;
+   };
+   /// A free block
+   struct Block {
+      /// The next free block
+      Block* next;
+   };
+   /// The blocks of one size class on one node
+   struct Pool {
+      /// The latch
+      Latch latch;
+      /// The free blocks
+      Block* free = nullptr;
+      /// The unused part of the current chunk
+      char *bump = nullptr, *limit = nullptr;
+   };
+
+   public:
+   /// The free blocks cached by a thread
+   struct Cache {
+      /// The node the blocks belong to
+      unsigned node;
+      /// Queries until the node is checked again
+      unsigned refresh;
+      /// Is the cache used? Only threads with a domain flush their cache at exit
+      bool active;
+      /// The free blocks per size class
+      Block* free[classes];
+      /// The number of free blocks per size class
+      unsigned count[classes];
+   };
+
+   private:
+   /// The pools
+   Pool pools[maxNodes][classes];
+
+   /// The size class of an allocation
+   static unsigned sizeClass(size_t size) noexcept { return size ? (size - 1) / granularity : 0; }
+   /// Allocate a chunk on the given node
+   static char* allocateChunk(unsigned node);
+   /// Take a block from a pool. Requires the latch
+   static Block* take(Pool& pool, unsigned sizeClass, unsigned node);
+   /// Move free blocks from the pool to the cache
+   void refill(Cache& cache, unsigned sizeClass);
+   /// Return cached blocks of one size class to the pool, keeping the given number of blocks
+   void release(Cache& cache, unsigned sizeClass, unsigned keep) noexcept;
+
+   public:
+   /// The node of a block
+   static unsigned nodeOf(const void* block) noexcept { return reinterpret_cast<const Chunk*>(reinterpret_cast<uintptr_t>(block) & ~(chunkSize - 1))->node; }
+   /// The node the current thread is running on
+   static unsigned currentNode() noexcept;
+   /// The node of the current thread as seen by the cache, checked periodically
+   unsigned threadNode() noexcept;
+
+   /// Allocate memory
+   void* allocate(size_t size);
+   /// Release memory
+   void deallocate(void* ptr, size_t size) noexcept;
+   /// Start caching blocks for the current thread
+   void enableCache() noexcept;
+   /// Return all cached blocks of the current thread and stop caching
+   void disableCache() noexcept;
+};
+//---------------------------------------------------------------------------
+/// The metadata memory
+static constinit NodeMemory nodeMemory;
+/// The cache of the current thread
+static constinit thread_local NodeMemory::Cache nodeCache{};
+//---------------------------------------------------------------------------
+char* NodeMemory::allocateChunk(unsigned node)
+// Allocate a chunk on the given node
+{
+   // Over-allocate to align the chunk, the node of a block is derived from its address
+   auto mem = static_cast<char*>(mmap(nullptr, 2 * chunkSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+   if (mem == MAP_FAILED) throw std::bad_alloc();
+   auto chunk = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(mem) + chunkSize - 1) & ~(chunkSize - 1));
+   if (chunk != mem) munmap(mem, chunk - mem);
+   if (chunk + chunkSize != mem + 2 * chunkSize) munmap(chunk + chunkSize, (mem + 2 * chunkSize) - (chunk + chunkSize));
+
+#if defined(__linux__) && defined(SYS_mbind)
+   // Prefer the node
+   unsigned long mask = 1ul << node;
+   if (syscall(SYS_mbind, chunk, chunkSize, MPOL_PREFERRED, &mask, maxNodes + 1, 0)) {
+      // The policy is not available (no NUMA support, seccomp, invalid node). The chunk keeps the default first-touch
+      // placement, which only costs locality, so we deliberately fall back silently
+   }
+#endif
+   new (chunk) Chunk{node};
+   return chunk;
+}
+//---------------------------------------------------------------------------
+NodeMemory::Block* NodeMemory::take(Pool& pool, unsigned sizeClass, unsigned node)
+// Take a block from a pool
+{
+   if (auto b = pool.free) {
+      pool.free = b->next;
+      return b;
+   }
+   size_t size = (sizeClass + 1) * granularity;
+   if (pool.bump + size > pool.limit) {
+      pool.bump = allocateChunk(node) + sizeof(Chunk);
+      pool.limit = pool.bump - sizeof(Chunk) + chunkSize;
+   }
+   auto b = reinterpret_cast<Block*>(pool.bump);
+   pool.bump += size;
+   return b;
+}
+//---------------------------------------------------------------------------
+unsigned NodeMemory::currentNode() noexcept
+// The node the current thread is running on
+{
+#ifdef __linux__
+   unsigned cpu, node;
+   if (!getcpu(&cpu, &node)) return node % maxNodes;
+#endif
+   return 0;
+}
+//---------------------------------------------------------------------------
+unsigned NodeMemory::threadNode() noexcept
+// The node of the current thread as seen by the cache
+{
+   auto& cache = nodeCache;
+   if (!cache.refresh--) {
+      // Cached blocks of the previous node go back to their pools when the thread moved
+      auto node = currentNode();
+      if ((node != cache.node) && cache.active)
+         for (unsigned c = 0; c != classes; ++c) release(cache, c, 0);
+      cache.node = node;
+      cache.refresh = refreshInterval;
+   }
+   return cache.node;
+}
+//---------------------------------------------------------------------------
+void NodeMemory::refill(Cache& cache, unsigned sizeClass)
+// Move free blocks from the pool to the cache
+{
+   auto node = threadNode();
+   auto& pool = pools[node][sizeClass];
+   std::lock_guard guard(pool.latch);
+   for (unsigned index = 0; index != batchSize; ++index) {
+      auto b = take(pool, sizeClass, node);
+      b->next = cache.free[sizeClass];
+      cache.free[sizeClass] = b;
+   }
+   cache.count[sizeClass] += batchSize;
+}
+//---------------------------------------------------------------------------
+void NodeMemory::release(Cache& cache, unsigned sizeClass, unsigned keep) noexcept
+// Return cached blocks of one size class to the pool
+{
+   if (cache.count[sizeClass] <= keep) return;
+   auto& pool = pools[cache.node][sizeClass];
+   std::lock_guard guard(pool.latch);
+   while (cache.count[sizeClass] > keep) {
+      auto b = cache.free[sizeClass];
+      cache.free[sizeClass] = b->next;
+      b->next = pool.free;
+      pool.free = b;
+      --cache.count[sizeClass];
+   }
+}
+//---------------------------------------------------------------------------
+void* NodeMemory::allocate(size_t size)
+// Allocate memory
+{
+   if (size > maxSize) return ::operator new(size);
+   auto c = sizeClass(size);
+   auto& cache = nodeCache;
+   if (!cache.active) {
+      auto node = currentNode();
+      auto& pool = pools[node][c];
+      std::lock_guard guard(pool.latch);
+      return take(pool, c, node);
+   }
+   if (!cache.free[c]) refill(cache, c);
+   auto b = cache.free[c];
+   cache.free[c] = b->next;
+   --cache.count[c];
+   return b;
+}
+//---------------------------------------------------------------------------
+void NodeMemory::deallocate(void* ptr, size_t size) noexcept
+// Release memory
+{
+   if (size > maxSize) return ::operator delete(ptr, size);
+   auto c = sizeClass(size);
+   auto b = static_cast<Block*>(ptr);
+   auto node = nodeOf(ptr);
+   auto& cache = nodeCache;
+   if (cache.active && (node == cache.node)) {
+      b->next = cache.free[c];
+      cache.free[c] = b;
+      if (++cache.count[c] > 2 * batchSize) release(cache, c, batchSize);
+      return;
+   }
+
+   // Blocks of other nodes go back to their pool
+   auto& pool = pools[node][c];
+   std::lock_guard guard(pool.latch);
+   b->next = pool.free;
+   pool.free = b;
+}
+//---------------------------------------------------------------------------
+void NodeMemory::enableCache() noexcept
+// Start caching blocks for the current thread
+{
+   nodeCache.active = true;
+}
+//---------------------------------------------------------------------------
+void NodeMemory::disableCache() noexcept
+// Return all cached blocks of the current thread and stop caching
+{
+   for (unsigned c = 0; c != classes; ++c) release(nodeCache, c, 0);
+   nodeCache.active = false;
+}
+//---------------------------------------------------------------------------
+/// An allocator for runtime metadata. Stateless, node handles can be moved between all tables
+template <class T>
+struct NodeAllocator {
+   using value_type = T;
+
+   /// Constructor
+   NodeAllocator() noexcept = default;
+   /// Rebind
+   template <class U>
+   NodeAllocator(const NodeAllocator<U>&) noexcept {}
+
+   /// Allocate
+   T* allocate(size_t n) { return static_cast<T*>(nodeMemory.allocate(n * sizeof(T))); }
+   /// Release
+   void deallocate(T* ptr, size_t n) noexcept { nodeMemory.deallocate(ptr, n * sizeof(T)); }
+   /// All allocators are equal
+   template <class U>
+   bool operator==(const NodeAllocator<U>&) const noexcept { return true; }
+};
+//---------------------------------------------------------------------------
+/// Count metadata accesses per node?
+static constinit std::atomic<bool> numaStatistics{false};
+/// The metadata accesses of threads that have exited
+static constinit std::atomic<unsigned long> exitedLocalAccesses{0}, exitedRemoteAccesses{0};
+//---------------------------------------------------------------------------
+/// The global epoch. Memory that is removed from the shared domain is tagged with the current epoch,
+/// and is released once no reader announces that epoch or an older one
+static constinit std::atomic<unsigned long> globalEpoch{1};
+/// Do we use membarrier to make the epoch announcements of readers visible? Then readers need no fence
+static constinit bool asymmetricFence = false;
+/// The number of incoming dependencies above which invalidation runs in parallel, 0 if disabled
+static constinit std::atomic<unsigned long> parallelThreshold{0};
+/// The number of threads used for parallel invalidation
+static constinit std::atomic<unsigned> parallelThreads{0};
+//---------------------------------------------------------------------------
+/// A persistent pool of threads that helps invalidating large cascades. Sized by set_parallel_invalidation, the
+/// threads sleep until a job is started. Only one invalidation uses the pool at a time, others run serially
+class InvalidationPool {
+   /// The worker threads
+   std::vector<std::thread> workers;
+   /// Held while resizing and while a job runs
+   std::mutex mutex;
+   /// The current job, called with the context and the index of the participant
+   void (*job)(void*, unsigned) = nullptr;
+   /// The context of the job
+   void* context = nullptr;
+   /// The number of participants of the job, including the starting thread
+   unsigned participants = 0;
+   /// The job generation. Idle workers wait until it changes
+   std::atomic<unsigned long> generation{0};
+   /// The number of workers that are still running the current job
+   std::atomic<unsigned> running{0};
+   /// Shut down? Written before the generation changes
+   bool stop = false;
+
+   /// The main loop of a worker
+   void work(unsigned index, unsigned long seen) noexcept {
+      while (true) {
+         generation.wait(seen, std::memory_order_acquire);
+         seen = generation.load(std::memory_order_acquire);
+         if (stop) return;
+         if (index < participants) job(context, index);
+         if (running.fetch_sub(1, std::memory_order_acq_rel) == 1) running.notify_one();
+      }
+   }
+
+   public:
+   /// Constructor
+   constexpr InvalidationPool() noexcept = default;
+   /// Destructor
+   ~InvalidationPool() { resize(0); }
+
+   /// Change the number of workers. Waits for a running job
+   void resize(unsigned count) noexcept {
+      std::lock_guard guard(mutex);
+      if (count == workers.size()) return;
+      if (!workers.empty()) {
+         stop = true;
+         generation.fetch_add(1, std::memory_order_release);
+         generation.notify_all();
+         for (auto& w : workers) w.join();
+         workers.clear();
+         stop = false;
+      }
+      // Fewer workers than requested are fine, the job is split among those that exist
+      try {
+         workers.reserve(count);
+         for (unsigned index = 1; index <= count; ++index) workers.emplace_back(&InvalidationPool::work, this, index, generation.load(std::memory_order_relaxed));
+      } catch (...) {
+      }
+   }
+   /// Start a job on the workers, which get the indices 1 to limit-1, the starting thread is participant 0. Returns false
+   /// if the pool is busy or empty, otherwise finish must be called
+   bool start(void (*newJob)(void*, unsigned), void* newContext, unsigned limit) noexcept {
+      if (!mutex.try_lock()) return false;
+      if (workers.empty()) {
+         mutex.unlock();
+         return false;
+      }
+      job = newJob;
+      context = newContext;
+      participants = limit;
+      running.store(workers.size(), std::memory_order_relaxed);
+      generation.fetch_add(1, std::memory_order_release);
+      generation.notify_all();
+      return true;
+   }
+   /// Wait until all workers have finished the job
+   void finish() noexcept {
+      for (auto r = running.load(std::memory_order_acquire); r; r = running.load(std::memory_order_acquire))
+         running.wait(r, std::memory_order_acquire);
+      mutex.unlock();
+   }
+};
+/// The pool for parallel invalidation. Constant initialized, so it outlives the domains
+static constinit InvalidationPool invalidationPool;
+//---------------------------------------------------------------------------
+/// Register for asymmetric fences
+static void registerAsymmetricFence() noexcept {
+#if defined(__linux__) && defined(SYS_membarrier)
+   asymmetricFence = !syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0);
+#endif
+}
+//---------------------------------------------------------------------------
+/// The reader side of the fence between announcing an epoch and reading shared data
+static void readerFence() noexcept {
+   if (asymmetricFence)
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+   else
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+//---------------------------------------------------------------------------
+/// The writer side of the fence. Afterwards, all announcements made before are visible
+static void writerFence() noexcept {
+#if defined(__linux__) && defined(SYS_membarrier)
+   if (asymmetricFence && !syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0)) return;
+#endif
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+//---------------------------------------------------------------------------
+/// A value that is accessed with relaxed atomic loads and stores. Used for the fields that validate reads without holding
+/// the latch. All writes happen either in the owning thread or under the latch, so no read-modify-write is needed
+template <class T>
+class Relaxed {
+   /// The value
+   std::atomic<T> value;
+
+   public:
+   /// Constructor
+   constexpr Relaxed(T value) noexcept : value(value) {}
+   /// Copy the value
+   Relaxed& operator=(const Relaxed& other) noexcept { return *this = static_cast<T>(other); }
+
+   /// Read the value
+   operator T() const noexcept { return value.load(std::memory_order_relaxed); }
+   /// Write the value
+   Relaxed& operator=(T v) noexcept {
+      value.store(v, std::memory_order_relaxed);
+      return *this;
+   }
+   /// Increment the value
+   Relaxed& operator++() noexcept { return *this = static_cast<T>(*this) + 1; }
+};
+//---------------------------------------------------------------------------
+/// A hash index that can be read without any synchronization besides an epoch announcement. Writers are serialized
+/// externally. Erased entries keep their key, so a slot never changes its key until the table is rebuilt. Replaced tables
+/// are retired and released once all readers have left the epoch
+template <class T>
+class ConcurrentIndex {
+   /// A slot
+   struct Slot {
+      /// The key
+      std::atomic<const void*> key{nullptr};
+      /// The value, nullptr if erased
+      std::atomic<T*> value{nullptr};
+   };
+   /// A table
+   struct Table {
+      /// The mask for slot positions
+      unsigned long mask;
+      /// The slots
+      std::unique_ptr<Slot[]> slots;
+
+      /// Constructor
+      explicit Table(unsigned long size) : mask(size - 1), slots(new Slot[size]) {}
+   };
+
+   /// The current table
+   std::atomic<Table*> table{nullptr};
+   /// The number of used slots, including erased entries
+   unsigned long used = 0;
+   /// The number of entries
+   unsigned long count = 0;
+   /// Retired tables together with their epoch
+   std::vector<std::pair<unsigned long, Table*>> retired;
+
+   /// Compute the start slot
+   static unsigned long hash(const void* key) noexcept { return (reinterpret_cast<unsigned long>(key) * 0x9e3779b97f4a7c15ull) >> 20; }
+   /// Find the slot for a key. Returns an unused slot if the key is not present
+   static Slot& findSlot(Table& t, const void* key) noexcept {
+      for (auto pos = hash(key);; ++pos) {
+         auto& s = t.slots[pos & t.mask];
+         auto k = s.key.load(std::memory_order_acquire);
+         if ((k == key) || (!k)) return s;
+      }
+   }
+   /// Rebuild the table with enough space
+   void rebuild() {
+      unsigned long size = 64;
+      while (size < 4 * (count + 1)) size *= 2;
+      auto n = new Table(size);
+      auto old = table.load(std::memory_order_relaxed);
+      if (old)
+         for (unsigned long index = 0; index <= old->mask; ++index) {
+            auto& s = old->slots[index];
+            if (auto v = s.value.load(std::memory_order_relaxed)) {
+               auto& d = findSlot(*n, s.key.load(std::memory_order_relaxed));
+               d.value.store(v, std::memory_order_relaxed);
+               d.key.store(s.key.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+         }
+      used = count;
+      table.store(n, std::memory_order_release);
+      if (old) retired.emplace_back(globalEpoch.load(), old);
+   }
+
+   public:
+   /// Constructor
+   constexpr ConcurrentIndex() noexcept = default;
+   /// Destructor
+   ~ConcurrentIndex() {
+      release(~0ul);
+      delete table.exchange(nullptr);
+   }
+
+   /// Find an entry. Requires an epoch announcement
+   T* find(const void* key) const noexcept {
+      auto t = table.load(std::memory_order_acquire);
+      if (!t) return nullptr;
+      return findSlot(*t, key).value.load(std::memory_order_acquire);
+   }
+   /// Insert an entry. Requires exclusive access
+   void insert(const void* key, T* value) {
+      auto t = table.load(std::memory_order_relaxed);
+      if ((!t) || (2 * (used + 1) > t->mask + 1)) {
+         rebuild();
+         t = table.load(std::memory_order_relaxed);
+      }
+      auto& s = findSlot(*t, key);
+      if (!s.value.load(std::memory_order_relaxed)) ++count;
+      s.value.store(value, std::memory_order_release);
+      if (!s.key.load(std::memory_order_relaxed)) {
+         ++used;
+         s.key.store(key, std::memory_order_release);
+      }
+   }
+   /// Erase an entry. Requires exclusive access
+   void erase(const void* key) noexcept {
+      auto t = table.load(std::memory_order_relaxed);
+      if (!t) return;
+      auto& s = findSlot(*t, key);
+      if (s.value.load(std::memory_order_relaxed)) {
+         s.value.store(nullptr, std::memory_order_relaxed);
+         --count;
+      }
+   }
+   /// Are there retired tables?
+   bool hasRetired() const noexcept { return !retired.empty(); }
+   /// Release all retired tables that are older than the given epoch
+   void release(unsigned long oldest) noexcept {
+      std::erase_if(retired, [&](auto& r) {
+         if (r.first >= oldest) return false;
+         delete r.second;
+         return true;
+      });
+   }
+};
+//---------------------------------------------------------------------------
+/// Memory safety logic. Every thread has its own domain that is used without synchronization,
+/// objects that are used by multiple threads live in a shared domain protected by a latch.
+/// Dependencies never cross domains, objects are always moved together with all objects that
+/// are connected to them by dependencies
 class MemorySafety {
    struct Dependency;
+   struct RemoteDependency;
 
    /// Information about an object
    struct Object {
+      /// The object itself
+      const void* key = nullptr;
       /// The dependencies of the object itself
       Dependency* dependencies = nullptr;
       /// The incoming dependencies
       Dependency* incoming[2] = {nullptr, nullptr};
+      /// The number of incoming dependencies
+      unsigned long incomingCount = 0;
+      /// The object whose generation we depend on, if any
+      Relaxed<Object*> generationSource = nullptr;
+      /// The generation of generationSource that we depend on
+      Relaxed<unsigned long> sourceGeneration = 0;
+      /// The current generation of the object itself
+      Relaxed<unsigned long> generation = 0;
+      /// The number of objects with a generation dependency on us that got content dependents. They are not checked
+      /// lazily by their dependents, so a new generation invalidates them eagerly. May overestimate
+      unsigned long eagerGenerationDependents = 0;
+      /// The number of active freezes
+      unsigned frozen = 0;
       /// Is the object still valid?
-      bool isValid = true;
+      Relaxed<bool> isValid = true;
+      /// Dependencies on objects of the shared domain, checked lazily
+      RemoteDependency* remote = nullptr;
+      /// The stamps of an object of the shared domain. Renewed when dependents on the existence or the content are invalidated
+      Relaxed<unsigned long> existenceStamp = 0, contentStamp = 0;
 
       Object() noexcept = default;
       Object(const Object&) = delete;
       Object(Object&&) = delete;
 
+      /// Is the object valid? Generation dependencies are checked lazily here
+      bool checkValid() const noexcept {
+         Object* source = generationSource;
+         return isValid && (!source || (source->generation == sourceGeneration));
+      }
       /// Invalidate objects that depend on this object
       void invalidateIncoming(bool contentOnly) noexcept;
+      /// Invalidate the dependents that depend on nothing but this object using multiple threads
+      void invalidateParallel(bool contentOnly, unsigned threads) noexcept;
       /// Invalidate an object, dropping all dependencies
       void invalidate() noexcept;
+      /// Drop all dependencies of the object itself
+      void dropDependencies() noexcept;
       /// Add a dependency
       void addDependency(Object* target, bool content) noexcept;
+      /// Note that the target got a content dependent
+      static void noteContentDependent(Object* target) noexcept;
+      /// Remove a dependency
+      void removeDependency(Dependency* dep) noexcept;
 
       /// Splay a dependency node
       void splay(Dependency* dep) noexcept;
@@ -71,25 +693,147 @@ class MemorySafety {
       void link() noexcept;
       /// Remove from dependency chain
       void unlink() noexcept;
+
+      /// Allocate on the node of the current thread
+      static void* operator new(size_t size) { return nodeMemory.allocate(size); }
+      /// Release
+      static void operator delete(void* ptr, size_t size) noexcept { nodeMemory.deallocate(ptr, size); }
+   };
+   /// A dependency of a thread local object on an object of the shared domain. Instead of linking into the incoming
+   /// lists of the shared object, every thread keeps these edges in its own domain and checks the stamps of the
+   /// target lazily, like a generation dependency. Registering them needs neither the latch nor a write to the target
+   struct RemoteDependency {
+      /// The object that is dependent on
+      const void* B;
+      /// The existence stamp of B
+      unsigned long existenceStamp;
+      /// The content stamp of B, 0 for existence dependencies
+      unsigned long contentStamp;
+      /// The next remote dependency
+      RemoteDependency* next;
+
+      /// Allocate on the node of the current thread
+      static void* operator new(size_t size) { return nodeMemory.allocate(size); }
+      /// Release
+      static void operator delete(void* ptr, size_t size) noexcept { nodeMemory.deallocate(ptr, size); }
    };
 
+   public:
+   /// The lookup table type
+   using Lookup = std::unordered_map<const void*, Object, std::hash<const void*>, std::equal_to<const void*>, NodeAllocator<std::pair<const void* const, Object>>>;
+   /// The objects are allocated in blocks of the node memory, which knows their NUMA node
+   static_assert(sizeof(Lookup::value_type) + sizeof(void*) <= NodeMemory::maxSize);
+   /// The nodes of a lookup table, used for moving objects between domains without changing their address
+   using Nodes = std::vector<Lookup::node_type>;
+
+   private:
    /// The lookup tables
-   std::unordered_map<const void*, Object> lookup;
+   Lookup lookup;
+   /// The latch protecting the lookup tables of the shared domain
+   Latch latch;
+   /// The index of the shared domain that is used by validate without holding the latch
+   ConcurrentIndex<const Object> index;
+   /// Objects removed from the shared domain that might still be seen by readers, together with their epoch
+   std::vector<std::pair<unsigned long, Lookup::node_type>> retired;
+   /// The epoch announced by the thread of this domain while reading the shared domain, 0 if not reading
+   mutable std::atomic<unsigned long> readEpoch;
+   /// The last stamp handed out in the shared domain
+   unsigned long stamps = 0;
+   /// Metadata accesses on the node of the thread and on other nodes
+   mutable Relaxed<unsigned long> localAccesses = 0, remoteAccesses = 0;
+   /// Objects that were transferred from other threads
+   Nodes inbox;
+   /// Objects that other threads have shared. If we track them, we move them to the shared domain
+   std::vector<const void*> claims;
+   /// The mutex protecting the inbox
+   std::mutex inboxMutex;
+   /// Are objects or claims waiting in the inbox?
+   std::atomic<bool> hasInbox;
+   /// The next domain in the registry
+   MemorySafety* nextDomain;
+   /// The id of the domain. 0 is the shared domain
+   unsigned long id;
+   /// Is this the shared domain?
+   bool shared;
    /// Initialized flag
    bool initialized;
 
+   /// Find or create an object
+   Object& obtain(const void* A) noexcept;
+   /// Add a node that was moved from another domain
+   void adopt(Lookup::node_type&& node) noexcept;
+   /// Move the dependencies of a stale entry for the same object to the adopted entry o
+   static void merge(Object& o, Object& stale) noexcept;
+   /// Propagate the invalid state and the dependencies of B to A
+   void propagate(const void* A, const void* B, bool contentOnly) noexcept;
+   /// Remove an object from the lookup tables. Objects of the shared domain are released after all readers are done
+   void erase(Lookup::iterator iter) noexcept;
+   /// The oldest epoch that is still announced by a reader
+   static unsigned long oldestEpoch() noexcept;
+   /// Release retired objects that are no longer visible to readers
+   void reclaim() noexcept;
+   /// Assign new stamps to an object of the shared domain
+   void renewStamps(Object& o, bool existence) noexcept;
+   /// Announce the current epoch before reading the shared domain
+   void enterEpoch() const noexcept;
+   /// Leave the epoch
+   void leaveEpoch() const noexcept { readEpoch.store(0, std::memory_order_release); }
+   /// Check the remote dependencies of an object
+   bool checkRemote(const RemoteDependency* remote) const noexcept;
+   /// Is the object valid? Includes the remote dependencies
+   bool checkValid(const Object& o) const noexcept { return o.checkValid() && ((!o.remote) || checkRemote(o.remote)); }
+   /// Merge a remote dependency into A. Returns false if A has an outdated dependency on the same object
+   static bool mergeRemote(Object& a, const RemoteDependency& r) noexcept;
+   /// Copy a new remote dependency of A to the objects that depend on the content of A, transitively
+   static void spreadRemote(Object& a, const RemoteDependency& r) noexcept;
+   /// Turn the remote dependencies of an object that entered the shared domain into regular dependencies
+   void resolveRemote(Object& a) noexcept;
+   /// Count an access to metadata
+   void countAccess(const Object& o) const noexcept;
+
    public:
    /// Constructor
-   MemorySafety();
+   explicit MemorySafety(bool shared);
    /// Destructor
    ~MemorySafety();
 
+   /// The domain id
+   unsigned long getId() const noexcept { return id; }
+   /// Is the object registered in this domain?
+   bool contains(const void* A) const noexcept { return lookup.find(A) != lookup.end(); }
+   /// Remove an object and all objects that are connected to it by dependencies
+   void extractComponent(const void* A, Nodes& nodes) noexcept;
+   /// Move an object and all objects that are connected to it into another domain
+   void moveComponent(const void* A, MemorySafety& target) noexcept;
+   /// Add objects that were moved from another domain
+   void adopt(Nodes& nodes) noexcept;
+   /// Are objects waiting in the inbox?
+   bool hasPendingObjects() const noexcept { return hasInbox.load(std::memory_order_acquire); }
+   /// Take the objects that other threads transferred to us
+   void drainInbox() noexcept;
+   /// Deliver objects to the domain with the given id. Returns false if the domain does not exist
+   static bool deliver(unsigned long id, Nodes& nodes) noexcept;
+   /// Ask all other thread domains to move the object A to the shared domain if they track it
+   static void claim(const void* A, const MemorySafety* except) noexcept;
+   /// Wait until all readers have left the epochs in which objects might still be visible in the shared domain
+   static void synchronize() noexcept;
+
    /// Validate an object
    void validate(const void* A) const noexcept;
+   /// Validate an object of the shared domain without holding the latch. Returns false if the object is not shared
+   bool validateConcurrent(const void* A, MemorySafety& reader) const noexcept;
+   /// Add a remote dependency of the local object A on the shared object B. Returns false if B is not shared
+   bool addRemoteDependency(const void* A, const void* B, bool content) noexcept;
+   /// Sum up the metadata accesses of all threads
+   static void collectAccesses(unsigned long& local, unsigned long& remote) noexcept;
    /// Add a dependency on the existence of B
    void addDependency(const void* A, const void* B) noexcept;
    /// Add a dependency on the content of B
    void addContentDependency(const void* A, const void* B) noexcept;
+   /// Add a dependency on the current generation of B
+   void addGenerationDependency(const void* A, const void* B) noexcept;
+   /// Start a new generation
+   void nextGeneration(const void* B) noexcept;
    /// Mark an object as modified
    void markModified(const void* B) noexcept;
    /// Mark an object as destroy
@@ -100,9 +844,23 @@ class MemorySafety {
    void propagateInvalid(const void* A, const void* B) noexcept;
    /// Like propagateInvalid, but pass over content dependencies, too
    void propagateContent(const void* A, const void* B) noexcept;
+   /// Like propagateInvalid, but pass over all dependencies
+   void propagateDependencies(const void* A, const void* B) noexcept;
+   /// Freeze an object
+   void freeze(const void* B) noexcept;
+   /// Undo a freeze
+   void unfreeze(const void* B) noexcept;
+   /// Invalidate all objects that depend on B, but keep B itself
+   void invalidateDependents(const void* B) noexcept;
+   /// Register an object without any dependencies
+   void registerObject(const void* A) noexcept { obtain(A); }
 
    /// Is the object initialized? This only works because global objects are zero initialized
    bool isAvailable() const noexcept { return initialized; }
+   /// Lock the runtime
+   void lock() noexcept { latch.lock(); }
+   /// Unlock the runtime
+   void unlock() noexcept { latch.unlock(); }
 };
 //---------------------------------------------------------------------------
 void MemorySafety::Dependency::link() noexcept
@@ -112,6 +870,7 @@ void MemorySafety::Dependency::link() noexcept
    next = B->incoming[content];
    if (next) next->prev = this;
    B->incoming[content] = this;
+   ++B->incomingCount;
 }
 //---------------------------------------------------------------------------
 void MemorySafety::Dependency::unlink() noexcept
@@ -123,6 +882,7 @@ void MemorySafety::Dependency::unlink() noexcept
       B->incoming[content] = next;
    }
    if (next) next->prev = prev;
+   --B->incomingCount;
 
    prev = next = nullptr;
 }
@@ -130,6 +890,10 @@ void MemorySafety::Dependency::unlink() noexcept
 void MemorySafety::Object::invalidateIncoming(bool contentOnly) noexcept
 // Invalidate objects that depend on this object
 {
+   // Split large cascades across threads first
+   auto threshold = parallelThreshold.load(std::memory_order_relaxed);
+   if (threshold && (incomingCount >= threshold)) invalidateParallel(contentOnly, parallelThreads.load(std::memory_order_relaxed));
+
    // Invalidate everything that depends on our content
    while (incoming[1]) incoming[1]->A->invalidate();
 
@@ -139,6 +903,62 @@ void MemorySafety::Object::invalidateIncoming(bool contentOnly) noexcept
    }
 }
 //---------------------------------------------------------------------------
+void MemorySafety::Object::invalidateParallel(bool contentOnly, unsigned threads) noexcept
+// Invalidate the dependents that depend on nothing but this object using multiple threads
+{
+   // The incoming dependencies are collected in chunks, workers start while we are still walking the lists
+   constexpr unsigned long chunkSize = 1024;
+   std::unique_ptr<Dependency*[]> deps(new Dependency*[incomingCount]);
+   std::atomic<unsigned long> collected{0}, nextChunk{0};
+   std::atomic<bool> done{false};
+
+   // Dependents that are connected to nothing else can be released independently of each other
+   std::vector<std::vector<Dependency*>> remaining(threads);
+   auto work = [&](unsigned index) {
+      while (true) {
+         auto begin = nextChunk.fetch_add(chunkSize), end = begin + chunkSize;
+         while ((collected.load(std::memory_order_acquire) < end) && (!done.load(std::memory_order_acquire))) std::this_thread::yield();
+         end = std::min(end, collected.load(std::memory_order_acquire));
+         if (begin >= end) return;
+
+         for (auto iter = begin; iter != end; ++iter) {
+            auto d = deps[iter];
+            auto a = d->A;
+            if ((a != this) && (a->dependencies == d) && (!d->left) && (!d->right) && (!a->incoming[0]) && (!a->incoming[1]) && (!a->remote)) {
+               a->isValid = false;
+               a->generationSource = nullptr;
+               a->dependencies = nullptr;
+               delete d;
+            } else {
+               remaining[index].push_back(d);
+            }
+         }
+      }
+   };
+   auto job = [](void* context, unsigned index) { (*static_cast<decltype(work)*>(context))(index); };
+   bool started = invalidationPool.start(job, &work, threads);
+
+   // Detach the incoming dependencies. The next pointer is read before a dependency is handed to the workers
+   unsigned long count = 0;
+   for (unsigned content = contentOnly; content < 2; ++content) {
+      for (auto d = incoming[content]; d;) {
+         deps[count++] = d;
+         d = d->next;
+         if (!(count % chunkSize)) collected.store(count, std::memory_order_release);
+      }
+      incoming[content] = nullptr;
+   }
+   incomingCount -= count;
+   collected.store(count, std::memory_order_release);
+   done.store(true, std::memory_order_release);
+   work(0);
+   if (started) invalidationPool.finish();
+
+   // The other dependents are linked again and invalidated serially
+   for (auto& r : remaining)
+      for (auto d : r) d->link();
+}
+//---------------------------------------------------------------------------
 void MemorySafety::Object::invalidate() noexcept
 // Invalidate an object, dropping all dependencies
 {
@@ -146,8 +966,18 @@ void MemorySafety::Object::invalidate() noexcept
       isValid = false;
       invalidateIncoming(true);
    }
-
-   // Drop all dependencies
+   dropDependencies();
+}
+//---------------------------------------------------------------------------
+void MemorySafety::Object::dropDependencies() noexcept
+// Drop all dependencies of the object itself
+{
+   generationSource = nullptr;
+   while (remote) {
+      auto r = remote;
+      remote = r->next;
+      delete r;
+   }
    auto d = dependencies;
    dependencies = nullptr;
    while (d) {
@@ -173,13 +1003,16 @@ void MemorySafety::Object::addDependency(Object* target, bool content) noexcept
    while (iter) {
       parent = iter;
       if (target < iter->B) {
+         iter = iter->left;
       } else if (target > iter->B) {
+         iter = iter->right;
       } else {
          // Existing dependency found, upgrade if needed
          if (content > iter->content) {
             iter->unlink();
             iter->content = true;
             iter->link();
+            noteContentDependent(target);
          }
          splay(iter);
          return;
@@ -208,6 +1041,41 @@ void MemorySafety::Object::addDependency(Object* target, bool content) noexcept
    d->link();
 
    splay(d);
+
+   // Our validity includes the lazy checks of the target, which we do not see. Remote dependencies are copied
+   if (content) {
+      noteContentDependent(target);
+      for (auto r = target->remote; r; r = r->next)
+         if (!mergeRemote(*this, *r)) return invalidate();
+   }
+}
+//---------------------------------------------------------------------------
+void MemorySafety::Object::noteContentDependent(Object* target) noexcept
+// Note that the target got a content dependent
+{
+   if (Object* source = target->generationSource) ++source->eagerGenerationDependents;
+}
+//---------------------------------------------------------------------------
+void MemorySafety::Object::removeDependency(Dependency* dep) noexcept
+// Remove a dependency
+{
+   // Splay the dependency to the root and join its subtrees
+   splay(dep);
+   auto left = dep->left, right = dep->right;
+   if (!left) {
+      dependencies = right;
+      if (right) right->parent = nullptr;
+   } else {
+      left->parent = nullptr;
+      dependencies = left;
+      auto max = left;
+      while (max->right) max = max->right;
+      splay(max);
+      max->right = right;
+      if (right) right->parent = max;
+   }
+   dep->unlink();
+   delete dep;
 }
 //---------------------------------------------------------------------------
 void MemorySafety::Object::splay(Dependency* dep) noexcept
@@ -276,57 +1144,489 @@ void MemorySafety::Object::rightRotate(Dependency* dep) noexcept
    dep->parent = o;
 }
 //---------------------------------------------------------------------------
-/// The memory safety logic
-static MemorySafety logic;
+/// The shared domain
+static MemorySafety sharedDomain(true);
+/// The domain of the current thread
+static thread_local MemorySafety localDomain(false);
+/// A pointer to the domain of the current thread. Avoids the initialization check of localDomain on every access
+static constinit thread_local MemorySafety* localPtr = nullptr;
+/// The registry of all thread domains
+static constinit MemorySafety* domains = nullptr;
+/// The mutex protecting the registry
+static constinit std::mutex domainsMutex;
+/// The next thread id
+static constinit std::atomic<unsigned long> nextThreadId{1};
 //---------------------------------------------------------------------------
-MemorySafety::MemorySafety() {
+MemorySafety::MemorySafety(bool shared)
+   : readEpoch(0), hasInbox(false), nextDomain(nullptr), id(shared ? 0 : current_thread()), shared(shared) {
+   if (shared) {
+      registerAsymmetricFence();
+   } else {
+      std::lock_guard guard(domainsMutex);
+      nextDomain = domains;
+      domains = this;
+      localPtr = this;
+      nodeMemory.enableCache();
+   }
    initialized = true;
 }
 //---------------------------------------------------------------------------
 MemorySafety::~MemorySafety() {
+   if (!shared) {
+      // Unregister, no more objects can arrive afterwards
+      localPtr = nullptr;
+      std::lock_guard guard(domainsMutex);
+      for (auto d = &domains; *d; d = &((*d)->nextDomain))
+         if (*d == this) {
+            *d = nextDomain;
+            break;
+         }
+   }
+   drainInbox();
+
    // Release all remaining dependencies
    for (auto& e : lookup)
       e.second.invalidate();
    lookup.clear();
+   retired.clear();
 
+   if (!shared) {
+      exitedLocalAccesses += localAccesses;
+      exitedRemoteAccesses += remoteAccesses;
+      nodeMemory.disableCache();
+   }
    initialized = false;
 }
 //---------------------------------------------------------------------------
+MemorySafety::Object& MemorySafety::obtain(const void* A) noexcept
+// Find or create an object
+{
+   auto& o = lookup[A];
+   if (!o.key) {
+      o.key = A;
+      if (shared) {
+         sharedFilter.insert(A);
+         renewStamps(o, true);
+         index.insert(A, &o);
+      }
+   }
+   return o;
+}
+//---------------------------------------------------------------------------
+void MemorySafety::adopt(Lookup::node_type&& node) noexcept
+// Add a node that was moved from another domain
+{
+   const void* A = node.key();
+   if (shared) sharedFilter.insert(A);
+
+   // Another thread might have registered the object in the meantime, e.g., by sharing an object that we still tracked.
+   // The dependencies of the new node point to its current location, the stale entry is merged into it
+   Lookup::node_type stale;
+   auto iter = lookup.find(A);
+   if (iter != lookup.end()) {
+      if (shared) index.erase(A);
+      stale = lookup.extract(iter);
+   }
+   auto& o = lookup.insert(std::move(node)).position->second;
+   if (shared) {
+      // Remote dependents of the stale entry stay valid
+      if (stale) {
+         o.existenceStamp = stale.mapped().existenceStamp;
+         o.contentStamp = stale.mapped().contentStamp;
+      } else {
+         renewStamps(o, true);
+      }
+      resolveRemote(o);
+   }
+   if (stale) {
+      merge(o, stale.mapped());
+      // Concurrent readers might still look at the stale entry
+      if (shared) {
+         retired.emplace_back(globalEpoch.load(), std::move(stale));
+         if (retired.size() >= 64) reclaim();
+      }
+   }
+   if (shared) index.insert(A, &o);
+}
+//---------------------------------------------------------------------------
+void MemorySafety::merge(Object& o, Object& stale) noexcept
+// Move the dependencies of a stale entry for the same object to the adopted entry o
+{
+   // Objects that depend on the stale entry depend on o now
+   for (bool content : {true, false})
+      while (auto d = stale.incoming[content]) {
+         auto a = d->A;
+         if (a->generationSource == &stale) {
+            if (a->sourceGeneration != stale.generation) {
+               a->invalidate();
+               continue;
+            }
+            a->generationSource = &o;
+            a->sourceGeneration = o.generation;
+         }
+         a->removeDependency(d);
+         a->addDependency(&o, content);
+      }
+
+   // The dependencies of the stale entry
+   if (!stale.isValid) o.isValid = false;
+   o.frozen += stale.frozen;
+   o.eagerGenerationDependents += stale.eagerGenerationDependents;
+   if (!o.generationSource && stale.generationSource) {
+      o.generationSource = stale.generationSource;
+      o.sourceGeneration = stale.sourceGeneration;
+      if (o.incoming[1]) Object::noteContentDependent(&o);
+   }
+   while (auto r = stale.remote) {
+      stale.remote = r->next;
+      r->next = o.remote;
+      o.remote = r;
+   }
+   std::vector<const Dependency*> stack;
+   if (stale.dependencies) stack.push_back(stale.dependencies);
+   while (!stack.empty()) {
+      auto d = stack.back();
+      stack.pop_back();
+      if (d->B != &o) o.addDependency(d->B, d->content);
+      if (d->left) stack.push_back(d->left);
+      if (d->right) stack.push_back(d->right);
+   }
+   stale.dropDependencies();
+}
+//---------------------------------------------------------------------------
+void MemorySafety::adopt(Nodes& nodes) noexcept
+// Add objects that were moved from another domain
+{
+   for (auto& n : nodes) adopt(std::move(n));
+   nodes.clear();
+}
+//---------------------------------------------------------------------------
+void MemorySafety::extractComponent(const void* A, Nodes& nodes) noexcept
+// Remove an object and all objects that are connected to it by dependencies
+{
+   std::vector<const Object*> todo;
+   auto visit = [&](const void* key) {
+      auto iter = lookup.find(key);
+      if (iter == lookup.end()) return;
+      todo.push_back(&iter->second);
+      if (shared) index.erase(key);
+      nodes.push_back(lookup.extract(iter));
+   };
+   visit(A);
+   std::vector<const Dependency*> stack;
+   while (!todo.empty()) {
+      auto o = todo.back();
+      todo.pop_back();
+
+      // Outgoing dependencies
+      if (o->dependencies) stack.push_back(o->dependencies);
+      while (!stack.empty()) {
+         auto d = stack.back();
+         stack.pop_back();
+         visit(d->B->key);
+         if (d->left) stack.push_back(d->left);
+         if (d->right) stack.push_back(d->right);
+      }
+
+      // Incoming dependencies
+      for (auto list : o->incoming)
+         for (auto d = list; d; d = d->next) visit(d->A->key);
+   }
+}
+//---------------------------------------------------------------------------
+void MemorySafety::moveComponent(const void* A, MemorySafety& target) noexcept
+// Move an object and all objects that are connected to it into another domain
+{
+   if (!contains(A)) return;
+   Nodes nodes;
+   extractComponent(A, nodes);
+   target.adopt(nodes);
+}
+//---------------------------------------------------------------------------
+void MemorySafety::drainInbox() noexcept
+// Take the objects that other threads transferred to us
+{
+   if (!hasInbox.load(std::memory_order_acquire)) return;
+   Nodes nodes;
+   std::vector<const void*> claimed;
+   {
+      std::lock_guard guard(inboxMutex);
+      nodes.swap(inbox);
+      claimed.swap(claims);
+      hasInbox.store(false, std::memory_order_relaxed);
+   }
+   adopt(nodes);
+
+   // Objects that other threads shared while we still tracked them
+   for (auto A : claimed)
+      if (contains(A)) {
+         std::lock_guard guard(sharedDomain);
+         moveComponent(A, sharedDomain);
+      }
+}
+//---------------------------------------------------------------------------
+bool MemorySafety::deliver(unsigned long id, Nodes& nodes) noexcept
+// Deliver objects to the domain with the given id
+{
+   std::lock_guard guard(domainsMutex);
+   for (auto d = domains; d; d = d->nextDomain)
+      if (d->id == id) {
+         std::lock_guard guard(d->inboxMutex);
+         for (auto& n : nodes) d->inbox.push_back(std::move(n));
+         nodes.clear();
+         d->hasInbox.store(true, std::memory_order_release);
+         return true;
+      }
+   return false;
+}
+//---------------------------------------------------------------------------
+void MemorySafety::claim(const void* A, const MemorySafety* except) noexcept
+// Ask all other thread domains to move the object A to the shared domain if they track it
+{
+   std::lock_guard guard(domainsMutex);
+   for (auto d = domains; d; d = d->nextDomain)
+      if (d != except) {
+         std::lock_guard guard(d->inboxMutex);
+         d->claims.push_back(A);
+         d->hasInbox.store(true, std::memory_order_release);
+      }
+}
+//---------------------------------------------------------------------------
+void MemorySafety::erase(Lookup::iterator iter) noexcept
+// Remove an object from the lookup tables
+{
+   if (!shared) {
+      lookup.erase(iter);
+      return;
+   }
+
+   // Concurrent readers might still look at the object
+   index.erase(iter->first);
+   retired.emplace_back(globalEpoch.load(), lookup.extract(iter));
+   if (retired.size() >= 64) reclaim();
+}
+//---------------------------------------------------------------------------
+unsigned long MemorySafety::oldestEpoch() noexcept
+// The oldest epoch that is still announced by a reader
+{
+   // Readers that announce the new epoch will not see anything that has been retired before
+   auto oldest = globalEpoch.fetch_add(1) + 1;
+   writerFence();
+   std::lock_guard guard(domainsMutex);
+   for (auto d = domains; d; d = d->nextDomain) {
+      auto e = d->readEpoch.load(std::memory_order_acquire);
+      if (e && (e < oldest)) oldest = e;
+   }
+   return oldest;
+}
+//---------------------------------------------------------------------------
+void MemorySafety::reclaim() noexcept
+// Release retired objects that are no longer visible to readers
+{
+   auto oldest = oldestEpoch();
+   std::erase_if(retired, [&](auto& r) { return r.first < oldest; });
+   index.release(oldest);
+}
+//---------------------------------------------------------------------------
+void MemorySafety::renewStamps(Object& o, bool existence) noexcept
+// Assign new stamps to an object of the shared domain
+{
+   o.contentStamp = ++stamps;
+   if (existence) o.existenceStamp = o.contentStamp;
+}
+//---------------------------------------------------------------------------
+void MemorySafety::enterEpoch() const noexcept
+// Announce the current epoch before reading the shared domain
+{
+   // Everything that we can reach afterwards stays alive until we leave the epoch
+   readEpoch.store(globalEpoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+   readerFence();
+}
+//---------------------------------------------------------------------------
+bool MemorySafety::checkRemote(const RemoteDependency* remote) const noexcept
+// Check the remote dependencies of an object
+{
+   bool valid = true;
+   enterEpoch();
+   for (auto r = remote; r && valid; r = r->next) {
+      auto b = sharedDomain.index.find(r->B);
+      valid = b && (b->existenceStamp == r->existenceStamp) && ((!r->contentStamp) || ((b->contentStamp == r->contentStamp) && b->checkValid()));
+   }
+   leaveEpoch();
+   return valid;
+}
+//---------------------------------------------------------------------------
+bool MemorySafety::mergeRemote(Object& a, const RemoteDependency& r) noexcept
+// Merge a remote dependency into A
+{
+   for (auto iter = a.remote; iter; iter = iter->next)
+      if (iter->B == r.B) {
+         if ((iter->existenceStamp != r.existenceStamp) || (iter->contentStamp && r.contentStamp && (iter->contentStamp != r.contentStamp))) return false;
+         if (r.contentStamp) iter->contentStamp = r.contentStamp;
+         return true;
+      }
+   a.remote = new RemoteDependency{r.B, r.existenceStamp, r.contentStamp, a.remote};
+   return true;
+}
+//---------------------------------------------------------------------------
+void MemorySafety::resolveRemote(Object& a) noexcept
+// Turn the remote dependencies of an object that entered the shared domain into regular dependencies
+{
+   if (!a.remote) return;
+   auto remote = a.remote;
+   a.remote = nullptr;
+
+   // The targets are in our lookup table if they are still the same objects
+   bool valid = true;
+   for (auto r = remote; r && valid; r = r->next) {
+      auto iter = lookup.find(r->B);
+      valid = (iter != lookup.end()) && (iter->second.existenceStamp == r->existenceStamp) && ((!r->contentStamp) || ((iter->second.contentStamp == r->contentStamp) && iter->second.checkValid()));
+   }
+   while (remote) {
+      auto r = remote;
+      remote = r->next;
+      if (valid) a.addDependency(&lookup.find(r->B)->second, r->contentStamp);
+      delete r;
+   }
+   if (!valid) a.invalidate();
+}
+//---------------------------------------------------------------------------
+void MemorySafety::countAccess(const Object& o) const noexcept
+// Count an access to metadata
+{
+   // Chunks are never released, the header is readable even if the object has been retired
+   if (NodeMemory::nodeOf(&o) == nodeMemory.threadNode())
+      ++localAccesses;
+   else
+      ++remoteAccesses;
+}
+//---------------------------------------------------------------------------
+void MemorySafety::collectAccesses(unsigned long& local, unsigned long& remote) noexcept
+// Sum up the metadata accesses of all threads
+{
+   std::lock_guard guard(domainsMutex);
+   local = exitedLocalAccesses;
+   remote = exitedRemoteAccesses;
+   for (auto d = domains; d; d = d->nextDomain) {
+      local += d->localAccesses;
+      remote += d->remoteAccesses;
+   }
+}
+//---------------------------------------------------------------------------
+void MemorySafety::synchronize() noexcept
+// Wait until all readers have left the epochs in which objects might still be visible in the shared domain
+{
+   auto current = globalEpoch.load();
+   while (oldestEpoch() <= current) std::this_thread::yield();
+}
+//---------------------------------------------------------------------------
 void MemorySafety::validate(const void* A) const noexcept
 // Validate an object
 {
    auto iter = lookup.find(A);
    if (iter != lookup.end()) {
-      if (!iter->second.isValid) {
+      if (numaStatistics.load(std::memory_order_relaxed)) countAccess(iter->second);
+      if (!checkValid(iter->second)) {
          violationHandler(A);
       }
    }
 }
 //---------------------------------------------------------------------------
+bool MemorySafety::validateConcurrent(const void* A, MemorySafety& reader) const noexcept
+// Validate an object of the shared domain without holding the latch
+{
+   reader.enterEpoch();
+   auto o = index.find(A);
+   bool valid = (!o) || o->checkValid();
+   reader.leaveEpoch();
+
+   if (!o) return false;
+   if (numaStatistics.load(std::memory_order_relaxed)) reader.countAccess(*o);
+   if (!valid) violationHandler(A);
+   return true;
+}
+//---------------------------------------------------------------------------
+bool MemorySafety::addRemoteDependency(const void* A, const void* B, bool content) noexcept
+// Add a remote dependency of the local object A on the shared object B
+{
+   // Read the stamps of B without taking the latch
+   enterEpoch();
+   auto b = sharedDomain.index.find(B);
+   RemoteDependency r{B, 0, 0, nullptr};
+   bool valid = true;
+   if (b) {
+      r.existenceStamp = b->existenceStamp;
+      if (content) {
+         r.contentStamp = b->contentStamp;
+         valid = b->checkValid();
+      }
+   }
+   leaveEpoch();
+   if (!b) return false;
+
+   auto& a = obtain(A);
+
+   // Stop operating in invalid objects
+   if (!a.isValid) return true;
+
+   // An outdated dependency on the same object means that A is invalid already
+   if ((!valid) || (!mergeRemote(a, r)))
+      a.invalidate();
+   else if (a.incoming[1])
+      spreadRemote(a, r);
+   return true;
+}
+//---------------------------------------------------------------------------
+void MemorySafety::spreadRemote(Object& a, const RemoteDependency& r) noexcept
+// Copy a new remote dependency of A to the objects that depend on the content of A, transitively
+{
+   auto known = [&](const Object& o) {
+      for (auto iter = o.remote; iter; iter = iter->next)
+         if (iter->B == r.B) return (iter->existenceStamp == r.existenceStamp) && ((!r.contentStamp) || (iter->contentStamp == r.contentStamp));
+      return false;
+   };
+
+   // The dependents are collected first, invalidating one of them unlinks it
+   std::vector<Object*> stack{&a}, dependents;
+   while (!stack.empty()) {
+      auto o = stack.back();
+      stack.pop_back();
+      dependents.clear();
+      for (auto d = o->incoming[1]; d; d = d->next) dependents.push_back(d->A);
+      for (auto x : dependents) {
+         if ((!x->isValid) || known(*x)) continue;
+         if (mergeRemote(*x, r))
+            stack.push_back(x);
+         else
+            x->invalidate();
+      }
+   }
+}
+//---------------------------------------------------------------------------
 void MemorySafety::addDependency(const void* A, const void* B) noexcept
 /// Add a dependency on the existence of B
 {
-   auto& a = lookup[A];
+   auto& a = obtain(A);
 
    // Stop operating in invalid objects
    if (!a.isValid) return;
 
-   auto& b = lookup[B];
+   auto& b = obtain(B);
    a.addDependency(&b, false);
 }
 //---------------------------------------------------------------------------
 void MemorySafety::addContentDependency(const void* A, const void* B) noexcept
 /// Add a dependency on the content of B
 {
-   auto& a = lookup[A];
+   auto& a = obtain(A);
 
    // Stop operating in invalid objects
    if (!a.isValid) return;
 
-   auto& b = lookup[B];
+   auto& b = obtain(B);
 
    // Is B invalid? Than we are immediately invalid, too
-   if (!b.isValid) {
+   if (!checkValid(b)) {
       a.invalidate();
       return;
    }
@@ -334,13 +1634,52 @@ void MemorySafety::addContentDependency(const void* A, const void* B) noexcept
    a.addDependency(&b, true);
 }
 //---------------------------------------------------------------------------
+void MemorySafety::addGenerationDependency(const void* A, const void* B) noexcept
+// Add a dependency on the current generation of B
+{
+   auto& a = obtain(A);
+
+   // Stop operating in invalid objects
+   if (!a.isValid) return;
+
+   // The existence dependency makes sure that we never see a dangling generation source
+   auto& b = obtain(B);
+   a.addDependency(&b, false);
+   a.generationSource = &b;
+   a.sourceGeneration = b.generation;
+   if (a.incoming[1]) Object::noteContentDependent(&a);
+}
+//---------------------------------------------------------------------------
+void MemorySafety::nextGeneration(const void* B) noexcept
+// Start a new generation
+{
+   auto iter = lookup.find(B);
+   if (iter == lookup.end()) return;
+   auto& b = iter->second;
+   ++b.generation;
+
+   // Generation dependents with content dependents are invalidated eagerly, which reaches their dependents
+   if (b.eagerGenerationDependents) {
+      std::vector<Object*> outdated;
+      for (auto d : b.incoming)
+         for (; d; d = d->next)
+            if ((d->A->generationSource == &b) && d->A->incoming[1]) outdated.push_back(d->A);
+      b.eagerGenerationDependents = 0;
+      for (auto a : outdated) a->invalidate();
+   }
+}
+//---------------------------------------------------------------------------
 void MemorySafety::markModified(const void* B) noexcept
 // Mark an object as modified
 {
    auto iter = lookup.find(B);
    if (iter != lookup.end()) {
+      // Frozen objects must not be modified
+      if (iter->second.frozen) violationHandler(B);
+
       // Invalidate everything that depends on the content
       iter->second.invalidateIncoming(true);
+      if (shared) renewStamps(iter->second, false);
    }
 }
 //---------------------------------------------------------------------------
@@ -349,10 +1688,16 @@ void MemorySafety::markDestroyed(const void* B) noexcept
 {
    auto iter = lookup.find(B);
    if (iter != lookup.end()) {
+      // Frozen objects must not be destroyed
+      if (iter->second.frozen) violationHandler(B);
+
       // Invalidate all dependencies
       iter->second.invalidateIncoming(false);
 
-      lookup.erase(iter);
+      // Drop the dependencies of the object itself
+      iter->second.invalidate();
+
+      erase(iter);
    }
 }
 //---------------------------------------------------------------------------
@@ -364,6 +1709,9 @@ void MemorySafety::reset(const void* A) noexcept
       // Reset all dependencies
       iter->second.invalidate();
       iter->second.isValid = true;
+
+      // Remote dependents saw the invalid state, they must not become valid again
+      if (shared) renewStamps(iter->second, false);
    }
 }
 //---------------------------------------------------------------------------
@@ -371,25 +1719,25 @@ void MemorySafety::propagateInvalid(const void* A, const void* B) noexcept
 // Mark an object A invalid if the other object B is invalid
 {
    auto iter = lookup.find(B);
-   if ((iter!=lookup.end())&&(!iter->second.isValid))
-      lookup[A].invalidate();
+   if ((iter!=lookup.end())&&(!checkValid(iter->second)))
+      obtain(A).invalidate();
 }
 //---------------------------------------------------------------------------
-void MemorySafety::propagateContent(const void* A, const void* B) noexcept
-// Like propagateInvalid, but pass over content dependencies, too
+void MemorySafety::propagate(const void* A, const void* B, bool contentOnly) noexcept
+// Propagate the invalid state and the dependencies of B to A
 {
    auto iter = lookup.find(B);
    if (iter!=lookup.end()) {
-      if (!iter->second.isValid) {
-         lookup[A].invalidate();
-      } else if (iter->second.dependencies) {
+      if (!checkValid(iter->second)) {
+         obtain(A).invalidate();
+      } else if (iter->second.dependencies || iter->second.remote) {
          auto& b = iter->second;
-         auto& a = lookup[A];
+         auto& a = obtain(A);
          if (a.isValid) {
 
             // Copy a dependency
             auto process = [&](const Dependency& d) {
-               if (d.content) a.addDependency(d.B, true);
+               if (d.content || !contentOnly) a.addDependency(d.B, d.content);
             };
 
             // Avoid memory allocations by using Morris traversal
@@ -412,51 +1760,241 @@ void MemorySafety::propagateContent(const void* A, const void* B) noexcept
                   }
                }
             }
+
+            // Copy the generation dependency. The existence dependency on the source has been copied above
+            if ((!contentOnly) && b.generationSource) {
+               a.generationSource = b.generationSource;
+               a.sourceGeneration = b.sourceGeneration;
+               if (a.incoming[1]) Object::noteContentDependent(&a);
+            }
+
+            // Copy the remote dependencies. They are up to date, we checked B above
+            for (auto r = b.remote; r; r = r->next)
+               if ((r->contentStamp || !contentOnly) && !mergeRemote(a, *r)) {
+                  a.invalidate();
+                  break;
+               }
          }
       }
    }
 }
 //---------------------------------------------------------------------------
+void MemorySafety::propagateContent(const void* A, const void* B) noexcept
+// Like propagateInvalid, but pass over content dependencies, too
+{
+   propagate(A, B, true);
+}
+//---------------------------------------------------------------------------
+void MemorySafety::propagateDependencies(const void* A, const void* B) noexcept
+// Like propagateInvalid, but pass over all dependencies
+{
+   propagate(A, B, false);
+}
+//---------------------------------------------------------------------------
+void MemorySafety::freeze(const void* B) noexcept
+// Freeze an object
+{
+   ++obtain(B).frozen;
+}
+//---------------------------------------------------------------------------
+void MemorySafety::unfreeze(const void* B) noexcept
+// Undo a freeze
+{
+   auto iter = lookup.find(B);
+   if ((iter != lookup.end()) && (iter->second.frozen)) --iter->second.frozen;
+}
+//---------------------------------------------------------------------------
+void MemorySafety::invalidateDependents(const void* B) noexcept
+// Invalidate all objects that depend on B, but keep B itself
+{
+   auto iter = lookup.find(B);
+   if (iter != lookup.end()) {
+      iter->second.invalidateIncoming(false);
+      if (shared) renewStamps(iter->second, true);
+   }
+}
+//---------------------------------------------------------------------------
+/// The domain of the current thread, if available
+static MemorySafety* local() noexcept {
+   auto l = localPtr;
+   if (!l) [[unlikely]] {
+      // Creates the domain on first use. After thread exit, the destroyed domain is no longer available
+      if (!localDomain.isAvailable()) return nullptr;
+      l = &localDomain;
+   }
+   if (l->hasPendingObjects()) [[unlikely]]
+      l->drainInbox();
+   return l;
+}
+//---------------------------------------------------------------------------
+/// Run an operation on the domain that contains the object A. New objects are created in the thread domain
+template <class F>
+static void dispatch(const void* A, F&& f) noexcept {
+   auto l = local();
+   if (l && !sharedFilter.mayContain(A)) return f(*l);
+   if (sharedDomain.isAvailable()) {
+      std::lock_guard guard(sharedDomain);
+      if ((!l) || sharedDomain.contains(A)) return f(sharedDomain);
+   }
+   if (l) f(*l);
+}
+//---------------------------------------------------------------------------
+/// Run an operation that involves the objects A and B. If one of them is shared, the other one is shared, too
+template <class F>
+static void dispatch(const void* A, const void* B, F&& f) noexcept {
+   auto l = local();
+   if (l && !sharedFilter.mayContain(A) && !sharedFilter.mayContain(B)) return f(*l);
+   if (sharedDomain.isAvailable()) {
+      std::lock_guard guard(sharedDomain);
+      bool sharedA = sharedDomain.contains(A), sharedB = sharedDomain.contains(B);
+      if ((!l) || sharedA || sharedB) {
+         if (l && !sharedA) l->moveComponent(A, sharedDomain);
+         if (l && !sharedB) l->moveComponent(B, sharedDomain);
+         return f(sharedDomain);
+      }
+   }
+   if (l) f(*l);
+}
+//---------------------------------------------------------------------------
+/// Register a dependency of a thread local object A on a shared object B in the thread domain. Returns false if not applicable
+static bool addRemote(const void* A, const void* B, bool content) noexcept {
+   auto l = local();
+   if ((!l) || sharedFilter.mayContain(A) || !sharedFilter.mayContain(B) || !sharedDomain.isAvailable()) return false;
+   return l->addRemoteDependency(A, B, content);
+}
+//---------------------------------------------------------------------------
 }
 //---------------------------------------------------------------------------
 /// Assert that the object A is still valid (i.e., no dependencies are violated)
 void validate(const void* A) noexcept {
-   if (logic.isAvailable()) logic.validate(A);
+   auto l = local();
+   if (l && !sharedFilter.mayContain(A)) return l->validate(A);
+
+   // Shared objects are checked without the latch, writers do not block us
+   if (l && sharedDomain.isAvailable()) {
+      if (!sharedDomain.validateConcurrent(A, *l)) l->validate(A);
+      return;
+   }
+   dispatch(A, [&](MemorySafety& logic) { logic.validate(A); });
 }
 //---------------------------------------------------------------------------
 /// Register a dependency between an object A and an object B. A cannot be used after B has been destroyed
 void add_dependency(const void* A, const void* B) noexcept {
-   if (logic.isAvailable()) logic.addDependency(A, B);
+   if (addRemote(A, B, false)) return;
+   dispatch(A, B, [&](MemorySafety& logic) { logic.addDependency(A, B); });
 }
 //---------------------------------------------------------------------------
 /// Register a dependency between an object A and an object B. A cannot be used after B has been modified
 void add_content_dependency(const void* A, const void* B) noexcept {
-   if (logic.isAvailable()) logic.addContentDependency(A, B);
+   if (addRemote(A, B, true)) return;
+   dispatch(A, B, [&](MemorySafety& logic) { logic.addContentDependency(A, B); });
+}
+//---------------------------------------------------------------------------
+/// Register a dependency between an object A and the current generation of an object B
+void add_generation_dependency(const void* A, const void* B) noexcept {
+   dispatch(A, B, [&](MemorySafety& logic) { logic.addGenerationDependency(A, B); });
+}
+//---------------------------------------------------------------------------
+/// Start a new generation of the object B. This invalidates all generation dependencies on B in constant time
+void next_generation(const void* B) noexcept {
+   dispatch(B, [&](MemorySafety& logic) { logic.nextGeneration(B); });
 }
 //---------------------------------------------------------------------------
 /// Mark the object B as modified
 void mark_modified(const void* B) noexcept {
-   if (logic.isAvailable()) logic.markModified(B);
+   dispatch(B, [&](MemorySafety& logic) { logic.markModified(B); });
 }
 //---------------------------------------------------------------------------
 /// Mark the object B as destroyed and release associated memory. Note that every object A or B that has been an argument to add.*dependency must be destroyed at some point
 void mark_destroyed(const void* B) noexcept {
-   if (logic.isAvailable()) logic.markDestroyed(B);
+   dispatch(B, [&](MemorySafety& logic) { logic.markDestroyed(B); });
 }
 //---------------------------------------------------------------------------
 /// Reset all dependencies of A and make it valid again
 void reset(const void* A) noexcept {
-   if (logic.isAvailable()) logic.reset(A);
+   dispatch(A, [&](MemorySafety& logic) { logic.reset(A); });
 }
 //---------------------------------------------------------------------------
 /// Mark an object A invalid if the other object B is invalid
 void propagate_invalid(const void* A, const void* B) noexcept {
-   if (logic.isAvailable()) logic.propagateInvalid(A, B);
+   dispatch(A, B, [&](MemorySafety& logic) { logic.propagateInvalid(A, B); });
 }
 //---------------------------------------------------------------------------
 /// Like propagate_invalid, but pass over content dependencies, too
 void propagate_content(const void* A, const void* B) noexcept {
-   if (logic.isAvailable()) logic.propagateContent(A, B);
+   dispatch(A, B, [&](MemorySafety& logic) { logic.propagateContent(A, B); });
+}
+//---------------------------------------------------------------------------
+/// Like propagate_invalid, but pass over all dependencies
+void propagate_dependencies(const void* A, const void* B) noexcept {
+   dispatch(A, B, [&](MemorySafety& logic) { logic.propagateDependencies(A, B); });
+}
+//---------------------------------------------------------------------------
+/// Freeze the object B. Modifying or destroying B while it is frozen is a violation. Freezes can be nested
+void freeze(const void* B) noexcept {
+   dispatch(B, [&](MemorySafety& logic) { logic.freeze(B); });
+}
+//---------------------------------------------------------------------------
+/// Undo a freeze of the object B
+void unfreeze(const void* B) noexcept {
+   dispatch(B, [&](MemorySafety& logic) { logic.unfreeze(B); });
+}
+//---------------------------------------------------------------------------
+/// Invalidate all objects that depend on B, like mark_destroyed, but keep B itself registered
+void invalidate_dependents(const void* B) noexcept {
+   dispatch(B, [&](MemorySafety& logic) { logic.invalidateDependents(B); });
+}
+//---------------------------------------------------------------------------
+/// The id of the runtime domain of the current thread
+unsigned long current_domain() noexcept {
+   auto l = local();
+   return l ? l->getId() : 0;
+}
+//---------------------------------------------------------------------------
+/// Move the object A and all objects connected to it by dependencies into the domain with the given id
+void transfer(const void* A, unsigned long domain) noexcept {
+   auto l = local();
+   if ((!sharedDomain.isAvailable()) || (l && (l->getId() == domain))) return;
+
+   // Sharing only involves the shared domain
+   if (!domain) {
+      std::lock_guard guard(sharedDomain);
+      if (l) l->moveComponent(A, sharedDomain);
+      return;
+   }
+
+   // Collect the objects and send them to the inbox of the target
+   MemorySafety::Nodes nodes;
+   if (l && l->contains(A)) {
+      l->extractComponent(A, nodes);
+   } else {
+      {
+         std::lock_guard guard(sharedDomain);
+         sharedDomain.extractComponent(A, nodes);
+      }
+      // Readers of the shared domain might still look at the objects, the target domain frees them without waiting
+      if (!nodes.empty()) MemorySafety::synchronize();
+   }
+   if (nodes.empty() || MemorySafety::deliver(domain, nodes)) return;
+
+   // The target thread is gone, keep the objects in the shared domain
+   std::lock_guard guard(sharedDomain);
+   sharedDomain.adopt(nodes);
+}
+//---------------------------------------------------------------------------
+/// Move the object A and all objects connected to it by dependencies into the shared domain
+void share(const void* A) noexcept {
+   if (!sharedDomain.isAvailable()) return;
+   auto l = local();
+   {
+      std::lock_guard guard(sharedDomain);
+      if (l && l->contains(A)) return l->moveComponent(A, sharedDomain);
+      if (sharedFilter.mayContain(A) && sharedDomain.contains(A)) return;
+      sharedDomain.registerObject(A);
+   }
+   // Another thread might still track the object. It moves its entry into the shared domain on its next runtime call,
+   // before it operates on the object again, and the entries are merged
+   MemorySafety::claim(A, l);
 }
 //---------------------------------------------------------------------------
 /// Change the violation handler. By default the program is terminated, but that is not very convenient for tests
@@ -464,6 +2002,26 @@ void set_violation_handler(void (*handler)(const void*)) noexcept {
    violationHandler = handler ? handler : defaultHandler;
 }
 //---------------------------------------------------------------------------
+/// Invalidate the dependents of objects with at least threshold incoming dependencies using the given number of threads
+void set_parallel_invalidation(unsigned long threshold, unsigned threads) noexcept {
+   parallelThreshold.store(0, std::memory_order_relaxed);
+   invalidationPool.resize(threads > 1 ? threads - 1 : 0);
+   parallelThreads.store(threads, std::memory_order_relaxed);
+   parallelThreshold.store(threads > 1 ? threshold : 0, std::memory_order_relaxed);
+}
+//---------------------------------------------------------------------------
+/// Enable or disable counting metadata accesses per NUMA node
+void set_numa_statistics(bool enabled) noexcept {
+   numaStatistics.store(enabled, std::memory_order_relaxed);
+}
+//---------------------------------------------------------------------------
+/// The metadata accesses of all threads counted so far
+numa_statistics get_numa_statistics() noexcept {
+   numa_statistics result;
+   MemorySafety::collectAccesses(result.local_accesses, result.remote_accesses);
+   return result;
+}
+//---------------------------------------------------------------------------
 void assert_spatial_failed() noexcept
 // Report that an assertion failed
 {
@@ -472,4 +2030,26 @@ void assert_spatial_failed() noexcept
    violationHandler(nullptr);
 }
 //---------------------------------------------------------------------------
+void owner_violation(const void* obj) noexcept
+// Report an access from a thread that does not own the object
+{
+   if (violationHandler == defaultHandler)
+      std::cerr << "object " << obj << " accessed from a thread that does not own it" << std::endl;
+   violationHandler(obj);
+}
+//---------------------------------------------------------------------------
+namespace detail {
+//---------------------------------------------------------------------------
+/// The id of the current thread
+constinit thread_local unsigned long threadId = 0;
+//---------------------------------------------------------------------------
+unsigned long assign_thread_id() noexcept
+// Assign an id to the current thread
+{
+   threadId = nextThreadId++;
+   return threadId;
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
 }
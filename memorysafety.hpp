@@ -13,6 +13,11 @@ void validate(const void* A) noexcept;
 void add_dependency(const void* A, const void* B) noexcept;
 /// Register a dependency between an object A and the content of an object B. A cannot be used after B has been modified
 void add_content_dependency(const void* A, const void* B) noexcept;
+/// Register a dependency between an object A and the current generation of an object B. A cannot be used after B has been destroyed or after B started a new generation. An object can depend on the generation of only one object
+void add_generation_dependency(const void* A, const void* B) noexcept;
+/// Start a new generation of the object B. This invalidates all generation dependencies on B in constant time, unless
+/// objects with a generation dependency on B have content dependents, which are invalidated eagerly
+void next_generation(const void* B) noexcept;
 /// Mark the object B as modified
 void mark_modified(const void* B) noexcept;
 /// Mark the object B as destroyed and release associated memory. Note that every object A or B that has been an argument to add.*dependency must be destroyed at some point
@@ -23,10 +28,67 @@ void reset(const void* A) noexcept;
 void propagate_invalid(const void* A, const void* B) noexcept;
 /// Like propagate_invalid, but pass over content dependencies, too
 void propagate_content(const void* A, const void* B) noexcept;
+/// Like propagate_invalid, but pass over all dependencies. Used for copying objects that can have different kinds of dependencies
+void propagate_dependencies(const void* A, const void* B) noexcept;
+/// Freeze the object B. Modifying or destroying B while it is frozen is a violation. Freezes can be nested
+void freeze(const void* B) noexcept;
+/// Undo a freeze of the object B
+void unfreeze(const void* B) noexcept;
+/// Invalidate all objects that depend on B, like mark_destroyed, but keep B itself registered
+void invalidate_dependents(const void* B) noexcept;
 //---------------------------------------------------------------------------
-/// Change the violation handler. By default the program is terminated, but that is not very convenient for tests
+// Objects are tracked in the runtime domain of the thread that registers them, which needs no
+// synchronization. Dependencies never cross domains: objects that are used by multiple threads
+// must be shared or transferred, together with all objects connected to them by dependencies.
+// The exception are existence and content dependencies of a thread object on a shared object,
+// they stay in the thread domain and are checked lazily, so many threads can depend on the same
+// shared object without contention. Objects with a content dependency on the thread object get a
+// copy of these checks, so invalidation stays transitive. Other dependencies with a shared object
+// share the thread object
+//---------------------------------------------------------------------------
+/// The id of the runtime domain of the current thread. Equal to current_thread()
+unsigned long current_domain() noexcept;
+/// Move the object A and all objects connected to it by dependencies into the domain of another thread. Domain 0 is the shared domain.
+/// Moving a shared object to a thread invalidates the thread objects that depend on it lazily
+void transfer(const void* A, unsigned long domain) noexcept;
+/// Move the object A and all objects connected to it by dependencies into the shared domain. A stays shared until it is destroyed.
+/// If another thread tracks A, that thread moves its entry into the shared domain on its next call into the runtime
+void share(const void* A) noexcept;
+//---------------------------------------------------------------------------
+namespace detail {
+/// The id of the current thread, 0 if none has been assigned yet
+extern constinit thread_local unsigned long threadId;
+/// Assign an id to the current thread
+unsigned long assign_thread_id() noexcept;
+}
+/// The id of the current thread. Ids are never reused, 0 is never a valid id
+inline unsigned long current_thread() noexcept {
+   unsigned long id = detail::threadId;
+   return id ? id : detail::assign_thread_id();
+}
+/// Report an access to an object from a thread that does not own it
+void owner_violation(const void* obj) noexcept;
+//---------------------------------------------------------------------------
+/// Change the violation handler. By default the program is terminated, but that is not very convenient for tests. The handler can be called while the shared domain is locked and must not call back into the runtime
 void set_violation_handler(void (*handler)(const void* obj)) noexcept;
 //---------------------------------------------------------------------------
+/// Invalidate the dependents of objects with at least threshold incoming dependencies using the given number of threads.
+/// Below the threshold, or with less than two threads, invalidation runs on the calling thread. Disabled by default.
+/// Keeps threads-1 helper threads alive until it is called again
+void set_parallel_invalidation(unsigned long threshold, unsigned threads) noexcept;
+//---------------------------------------------------------------------------
+/// Counts of metadata accesses by validate. Metadata is allocated on the NUMA node of the registering thread
+struct numa_statistics {
+   /// Accesses to metadata on the node of the accessing thread
+   unsigned long local_accesses;
+   /// Accesses to metadata on another node
+   unsigned long remote_accesses;
+};
+/// Enable or disable counting metadata accesses. Disabled by default
+void set_numa_statistics(bool enabled) noexcept;
+/// The metadata accesses of all threads counted so far
+numa_statistics get_numa_statistics() noexcept;
+//---------------------------------------------------------------------------
 /// Report that an assertion failed
 void assert_spatial_failed() noexcept;
 /// Helper for spatial asserts
@@ -0,0 +1,211 @@
+#include "memorysafety.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+//---------------------------------------------------------------------------
+// Concurrency scaling benchmark for the memory safety runtime
+// (c) 2023 Thomas Neumann
+// SPDX-License-Identifier: MIT
+//---------------------------------------------------------------------------
+using namespace std;
+//---------------------------------------------------------------------------
+namespace {
+//---------------------------------------------------------------------------
+/// The operations
+enum Op : unsigned { Validate, Add, Modify, Destroy, OpCount };
+/// The names of the operations
+const char* const opNames[OpCount] = {"validate", "add", "modify", "destroy"};
+//---------------------------------------------------------------------------
+/// The object patterns
+enum Pattern : unsigned { Private, SharedRead, SharedWrite, PatternCount };
+/// The names of the patterns
+const char* const patternNames[PatternCount] = {"private", "shared-read", "shared-write"};
+//---------------------------------------------------------------------------
+/// The configuration
+struct Config {
+   /// The maximum number of threads
+   unsigned threads;
+   /// The operations per thread
+   unsigned ops = 1 << 20;
+   /// The weights of the operations
+   unsigned mix[OpCount] = {70, 15, 10, 5};
+   /// Every n-th operation is timed
+   unsigned sampleRate = 16;
+};
+//---------------------------------------------------------------------------
+/// The number of targets per thread or in the shared set
+constexpr unsigned targetCount = 64;
+/// The number of dependent objects per thread
+constexpr unsigned dependentCount = 1024;
+//---------------------------------------------------------------------------
+/// An object tracked by the runtime. Only the address matters
+struct alignas(64) Object {
+   char data[64];
+};
+//---------------------------------------------------------------------------
+/// A fast random number generator
+class Random {
+   /// The state
+   uint64_t state;
+
+   public:
+   /// Constructor
+   explicit Random(uint64_t seed) : state(seed * 0x9e3779b97f4a7c15ull + 1) {}
+   /// The next number
+   uint64_t next() {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      return state;
+   }
+};
+//---------------------------------------------------------------------------
+/// The results of one thread
+struct ThreadResult {
+   /// The sampled latencies in nanoseconds per operation
+   vector<unsigned> latencies[OpCount];
+};
+//---------------------------------------------------------------------------
+/// Count violations silently, invalidated dependents are expected
+atomic<unsigned long> violations{0};
+//---------------------------------------------------------------------------
+/// Run one thread of a benchmark
+void runThread(const Config& config, Pattern pattern, unsigned worker, Object* sharedTargets, ThreadResult& result) {
+   vector<Object> privateTargets(targetCount), dependents(dependentCount);
+   Random random(worker + 1);
+   unsigned totalWeight = 0;
+   for (auto w : config.mix) totalWeight += w;
+
+   // Shared patterns read shared targets, only shared-write modifies them
+   auto readTarget = [&](uint64_t r) { return (pattern == Private) ? &privateTargets[r % targetCount] : &sharedTargets[r % targetCount]; };
+   auto writeTarget = [&](uint64_t r) { return (pattern == SharedWrite) ? &sharedTargets[r % targetCount] : &privateTargets[r % targetCount]; };
+   for (unsigned index = 0; index != dependentCount; ++index) memorysafety::add_content_dependency(&dependents[index], readTarget(random.next()));
+
+   for (auto& l : result.latencies) l.reserve(config.ops / config.sampleRate / OpCount * 2);
+   for (unsigned index = 0; index != config.ops; ++index) {
+      uint64_t r = random.next();
+      unsigned choice = (r >> 40) % totalWeight, op = 0;
+      while (choice >= config.mix[op]) choice -= config.mix[op++];
+      auto dependent = &dependents[(r >> 20) % dependentCount];
+
+      bool sample = !(index % config.sampleRate);
+      auto start = sample ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
+      switch (op) {
+         case Validate: memorysafety::validate(dependent); break;
+         case Add:
+            memorysafety::reset(dependent);
+            memorysafety::add_content_dependency(dependent, readTarget(r));
+            break;
+         case Modify: memorysafety::mark_modified(writeTarget(r)); break;
+         case Destroy:
+            memorysafety::mark_destroyed(dependent);
+            memorysafety::add_content_dependency(dependent, readTarget(r));
+            break;
+      }
+      if (sample) result.latencies[op].push_back(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+   }
+
+   for (auto& d : dependents) memorysafety::mark_destroyed(&d);
+   for (auto& t : privateTargets) memorysafety::mark_destroyed(&t);
+}
+//---------------------------------------------------------------------------
+/// Run a pattern with a given number of threads. Returns the throughput in operations per second
+double runPattern(const Config& config, Pattern pattern, unsigned threads, ThreadResult& merged) {
+   vector<Object> sharedTargets(targetCount);
+   if (pattern != Private)
+      for (auto& t : sharedTargets) memorysafety::share(&t);
+
+   vector<ThreadResult> results(threads);
+   vector<thread> workers;
+   atomic<unsigned> ready{0};
+   atomic<bool> go{false};
+   for (unsigned index = 0; index != threads; ++index)
+      workers.emplace_back([&, index]() {
+         ++ready;
+         while (!go.load()) this_thread::yield();
+         runThread(config, pattern, index, sharedTargets.data(), results[index]);
+      });
+   while (ready.load() != threads) this_thread::yield();
+   auto start = chrono::steady_clock::now();
+   go = true;
+   for (auto& w : workers) w.join();
+   double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+   for (auto& t : sharedTargets) memorysafety::mark_destroyed(&t);
+   for (auto& r : results)
+      for (unsigned op = 0; op != OpCount; ++op) merged.latencies[op].insert(merged.latencies[op].end(), r.latencies[op].begin(), r.latencies[op].end());
+   return static_cast<double>(config.ops) * threads / seconds;
+}
+//---------------------------------------------------------------------------
+/// Print the latency percentiles of all operations
+void printLatencies(ThreadResult& result) {
+   for (unsigned op = 0; op != OpCount; ++op) {
+      auto& l = result.latencies[op];
+      if (l.empty()) continue;
+      sort(l.begin(), l.end());
+      auto percentile = [&](double p) { return l[min<size_t>(l.size() - 1, l.size() * p)]; };
+      printf("      %-8s p50 %6uns  p90 %6uns  p99 %6uns  p99.9 %6uns\n", opNames[op], percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999));
+   }
+}
+//---------------------------------------------------------------------------
+/// Parse an operation mix like 70:15:10:5
+bool parseMix(const char* str, Config& config) {
+   unsigned total = 0;
+   for (unsigned op = 0; op != OpCount; ++op) {
+      char* end;
+      config.mix[op] = strtoul(str, &end, 10);
+      total += config.mix[op];
+      if ((end == str) || (*end != ((op + 1 < OpCount) ? ':' : '\0'))) return false;
+      str = end + 1;
+   }
+   return total > 0;
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+int main(int argc, char* argv[]) {
+   if ((argc > 1) && ((strcmp(argv[1], "-h") == 0) || (strcmp(argv[1], "--help") == 0))) {
+      printf("usage: %s [threads] [pattern] [validate:add:modify:destroy] [ops per thread]\npatterns: all", argv[0]);
+      for (auto p : patternNames) printf(" %s", p);
+      printf("\n");
+      return 0;
+   }
+   Config config;
+   config.threads = (argc > 1) ? atoi(argv[1]) : thread::hardware_concurrency();
+   if (!config.threads) config.threads = 1;
+   unsigned firstPattern = 0, lastPattern = PatternCount;
+   if ((argc > 2) && strcmp(argv[2], "all")) {
+      for (firstPattern = 0; firstPattern != PatternCount; ++firstPattern)
+         if (!strcmp(argv[2], patternNames[firstPattern])) break;
+      if (firstPattern == PatternCount) {
+         fprintf(stderr, "unknown pattern %s\n", argv[2]);
+         return 1;
+      }
+      lastPattern = firstPattern + 1;
+   }
+   if ((argc > 3) && !parseMix(argv[3], config)) {
+      fprintf(stderr, "invalid operation mix %s\n", argv[3]);
+      return 1;
+   }
+   if ((argc > 4) && !(config.ops = atoi(argv[4]))) config.ops = 1;
+   memorysafety::set_violation_handler([](const void*) { violations.fetch_add(1, memory_order_relaxed); });
+
+   printf("scaling: %u operations per thread, mix validate:add:modify:destroy %u:%u:%u:%u\n", config.ops, config.mix[0], config.mix[1], config.mix[2], config.mix[3]);
+   for (unsigned pattern = firstPattern; pattern != lastPattern; ++pattern) {
+      printf("%s\n", patternNames[pattern]);
+      double base = 0;
+      for (unsigned threads = 1; threads <= config.threads; threads = (threads < config.threads) ? min(threads * 2, config.threads) : threads + 1) {
+         ThreadResult latencies;
+         double throughput = runPattern(config, static_cast<Pattern>(pattern), threads, latencies);
+         if (threads == 1) base = throughput;
+         printf("   %3u threads: %8.2fM ops/s, efficiency %5.1f%%\n", threads, throughput / 1e6, 100.0 * throughput / (base * threads));
+         printLatencies(latencies);
+      }
+   }
+   printf("violations reported: %lu\n", violations.load());
+}
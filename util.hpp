@@ -6,9 +6,37 @@
 // SPDX-License-Identifier: MIT
 //---------------------------------------------------------------------------
 #include "memorysafety.hpp"
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <functional>
 #include <iosfwd>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <thread>
+#include <tuple>
+#include <type_traits>
 #include <utility>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 //---------------------------------------------------------------------------
 // Utility classes that provide memory-safe abstractions
 //
@@ -24,6 +52,54 @@ template <class T>
 void ref_wrapper_fun(T&&) = delete;
 }
 //---------------------------------------------------------------------------
+#ifdef MEMORYSAFETY_OWNER_CHECKS
+/// The thread that owns an object. Accessing an object from another thread is reported unless
+/// the object has been shared. The check is a single compare against a thread-local id, which
+/// is cheap enough to stay enabled in load tests. Enabled with MEMORYSAFETY_OWNER_CHECKS,
+/// otherwise the tag is empty and all checks are no-ops
+class owner_tag {
+   /// The owning thread, 0 if shared
+   unsigned long _owner;
+
+   public:
+   /// Constructor. Objects are owned by the thread that creates them
+   constexpr owner_tag() noexcept : _owner(std::is_constant_evaluated() ? 0 : memorysafety::current_thread()) {}
+   /// Copy constructor. Copies are owned by the copying thread
+   constexpr owner_tag(const owner_tag&) noexcept : owner_tag() {}
+   /// Assignment. Keeps the owner
+   constexpr owner_tag& operator=(const owner_tag&) noexcept { return *this; }
+
+   /// Check that the current thread may access the object
+   void check(const void* obj) const noexcept {
+      if (_owner && (_owner != memorysafety::current_thread())) memorysafety::owner_violation(obj);
+   }
+   /// Check the owner and validate the object
+   void validate(const void* obj) const noexcept {
+      check(obj);
+      memorysafety::validate(obj);
+   }
+   /// Allow access from all threads. Sharing again does not write, other threads may be reading the tag
+   void share() noexcept {
+      if (_owner) _owner = 0;
+   }
+   /// Hand the object to another thread
+   void transfer(unsigned long thread) noexcept { _owner = thread; }
+};
+#else
+/// The thread that owns an object. Owner checks are disabled, define MEMORYSAFETY_OWNER_CHECKS to enable them
+class owner_tag {
+   public:
+   /// Check that the current thread may access the object
+   void check(const void*) const noexcept {}
+   /// Check the owner and validate the object
+   void validate(const void* obj) const noexcept { memorysafety::validate(obj); }
+   /// Allow access from all threads
+   void share() noexcept {}
+   /// Hand the object to another thread
+   void transfer(unsigned long) noexcept {}
+};
+#endif
+//---------------------------------------------------------------------------
 /// A reference wrapper modeled after std::reference_wrapper but with memory safety checks
 template <class T>
 class ref_wrapper {
@@ -65,11 +141,11 @@ class ref_wrapper {
 
    // access
    constexpr operator T&() const noexcept {
-      memorysafety::validate(this);
+      _owner.validate(this);
       return *_ptr;
    }
    constexpr T& get() const noexcept {
-      memorysafety::validate(this);
+      _owner.validate(this);
       return *_ptr;
    }
 
@@ -81,6 +157,8 @@ class ref_wrapper {
 
    private:
    T* _ptr;
+   /// The owning thread
+   [[no_unique_address]] owner_tag _owner;
 };
 //---------------------------------------------------------------------------
 /// A reference wrapper for objects that depend on an outer object being unmodified
@@ -122,11 +200,11 @@ class inner_ref_wrapper {
 
    // access
    constexpr operator T&() const noexcept {
-      memorysafety::validate(this);
+      _owner.validate(this);
       return *_ptr;
    }
    constexpr T& get() const noexcept {
-      memorysafety::validate(this);
+      _owner.validate(this);
       return *_ptr;
    }
 
@@ -138,372 +216,3799 @@ class inner_ref_wrapper {
 
    private:
    T* _ptr;
+   /// The owning thread
+   [[no_unique_address]] owner_tag _owner;
 };
 //---------------------------------------------------------------------------
-/// A simple string implementation that demonstrates safety primitives
-class ms_string {
+/// A reference wrapper for elements that depend on an outer object being unmodified and on the existence of the element slot
+template <class T>
+class element_ref_wrapper {
    public:
-   using value_type = char;
-   using size_type = unsigned long;
-   using difference_type = long;
-   using reference = inner_ref_wrapper<char>;
-   using const_reference = inner_ref_wrapper<const char>;
-
-   static constexpr size_type npos = ~static_cast<size_type>(0);
+   // types
+   typedef T type;
 
-   /// An iterator
-   class iterator {
-      private:
-      char *iter, *limit;
+   // construct/copy/destroy
+   template <class U, class = decltype(detail::ref_wrapper_fun<T>(std::declval<U>()), std::enable_if_t<!std::is_same_v<element_ref_wrapper, std::remove_cvref_t<U>>>())>
+   constexpr element_ref_wrapper(const void* outer, const void* element, U&& u) noexcept(noexcept(detail::ref_wrapper_fun<T>(std::forward<U>(u))))
+      : _ptr(std::addressof(detail::ref_wrapper_fun<T>(std::forward<U>(u)))), _element(element) {
+      // The reference depends on the outer object and on the element
+      memorysafety::add_content_dependency(this, outer);
+      memorysafety::add_dependency(this, element);
+   }
+   element_ref_wrapper(const element_ref_wrapper& o) noexcept
+      : _ptr(o._ptr), _element(o._element) {
+      // Copy the dependencies from the other reference and propagate invalid states
+      memorysafety::propagate_content(this, &o);
+      memorysafety::add_dependency(this, _element);
+   }
+   ~element_ref_wrapper() {
+      // The reference was destroyed
+      memorysafety::mark_destroyed(this);
+   }
 
-      friend class ms_string;
+   // assignment
+   element_ref_wrapper& operator=(const element_ref_wrapper& o) noexcept {
+      if (this != &o) {
+         // Clear all existing dependencies make valid again
+         memorysafety::reset(this);
 
-      iterator(ms_string* outer, char* iter, char* limit) noexcept : iter(iter), limit(limit) {
-         memorysafety::add_content_dependency(this, outer);
+         // Copy the dependencies from the other reference and propagate invalid states
+         _ptr = o._ptr;
+         _element = o._element;
+         memorysafety::propagate_content(this, &o);
+         memorysafety::add_dependency(this, _element);
       }
+      return *this;
+   }
 
-      public:
-      constexpr iterator() noexcept : iter(nullptr), limit(nullptr) {}
-      iterator(const iterator& o) noexcept : iter(o.iter), limit(o.limit) { memorysafety::propagate_content(this, &o); }
-      ~iterator() { memorysafety::mark_destroyed(this); }
+   // access
+   constexpr operator T&() const noexcept {
+      _owner.validate(this);
+      return *_ptr;
+   }
+   constexpr T& get() const noexcept {
+      _owner.validate(this);
+      return *_ptr;
+   }
 
-      iterator& operator=(const iterator& o) noexcept {
-         if (this != &o) {
-            memorysafety::reset(this);
-            iter = o.iter;
-            limit = o.limit;
-            memorysafety::propagate_content(this, &o);
-         }
-         return *this;
-      }
+   template <class... ArgTypes>
+   constexpr std::invoke_result_t<T&, ArgTypes...>
+   operator()(ArgTypes&&... args) const {
+      return std::invoke(get(), std::forward<ArgTypes>(args)...);
+   }
 
-      iterator& operator++() {
-         memorysafety::assert_spatial(iter != limit);
-         ++iter;
-         return *this;
-      }
-      iterator& operator+=(long step) {
-         memorysafety::assert_spatial((step >= 0) && (step < (limit - iter)));
-         iter += step;
-         return *this;
-      }
-      iterator operator+(long step) const {
-         iterator res = *this;
-         res += step;
-         return res;
-      }
-      char& operator*() const {
-         memorysafety::assert_spatial(iter < limit);
-         memorysafety::validate(this);
-         return *iter;
-      }
+   private:
+   T* _ptr;
+   const void* _element;
+   /// The owning thread
+   [[no_unique_address]] owner_tag _owner;
+};
+//---------------------------------------------------------------------------
+/// A unique pointer whose pointee participates in existence tracking. References obtained
+/// via ref() become invalid when the pointer releases the object. Access through the
+/// pointer itself needs no runtime lookup, as the owner is valid by construction
+template <class T>
+class ms_unique_ptr {
+   /// The object
+   T* _ptr;
 
-      bool operator==(const iterator& o) const { return iter == o.iter; }
-      bool operator!=(const iterator& o) const { return iter != o.iter; }
-      bool operator<(const iterator& o) const { return iter < o.iter; }
-      bool operator<=(const iterator& o) const { return iter <= o.iter; }
-      bool operator>(const iterator& o) const { return iter > o.iter; }
-      bool operator>=(const iterator& o) const { return iter >= o.iter; }
-   };
-   /// A const iterator
-   class const_iterator {
-      private:
-      const char *iter, *limit;
+   template <class U>
+   friend class ms_unique_ptr;
 
-      friend class ms_string;
+   public:
+   using element_type = T;
+   using pointer = T*;
 
-      const_iterator(const ms_string* outer, const char* iter, const char* limit) noexcept : iter(iter), limit(limit) {
-         memorysafety::add_content_dependency(this, outer);
-      }
+   /// Constructor
+   constexpr ms_unique_ptr() noexcept : _ptr(nullptr) {}
+   /// Constructor
+   constexpr ms_unique_ptr(std::nullptr_t) noexcept : _ptr(nullptr) {}
+   /// Constructor. Takes ownership of the object
+   explicit ms_unique_ptr(T* ptr) noexcept : _ptr(ptr) {}
+   /// Move constructor
+   ms_unique_ptr(ms_unique_ptr&& o) noexcept : _ptr(o._ptr) { o._ptr = nullptr; }
+   /// Move constructor from a derived type
+   template <class U, class = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+   ms_unique_ptr(ms_unique_ptr<U>&& o) noexcept : _ptr(o._ptr) { o._ptr = nullptr; }
+   /// Destructor
+   ~ms_unique_ptr() { reset(); }
 
-      public:
-      constexpr const_iterator() noexcept : iter(nullptr), limit(nullptr) {}
-      const_iterator(const const_iterator& o) noexcept : iter(o.iter), limit(o.limit) { memorysafety::propagate_content(this, &o); }
-      ~const_iterator() { memorysafety::mark_destroyed(this); }
+   /// Assignment
+   ms_unique_ptr& operator=(ms_unique_ptr&& o) noexcept {
+      if (this != &o) reset(o.release());
+      return *this;
+   }
+   /// Assignment
+   ms_unique_ptr& operator=(std::nullptr_t) noexcept {
+      reset();
+      return *this;
+   }
 
-      const_iterator& operator=(const const_iterator& o) noexcept {
-         if (this != &o) {
-            memorysafety::reset(this);
-            iter = o.iter;
-            limit = o.limit;
-            memorysafety::propagate_content(this, &o);
-         }
-         return *this;
+   /// Destroy the current object and take ownership of a new one
+   void reset(T* ptr = nullptr) noexcept {
+      T* old = _ptr;
+      _ptr = ptr;
+      if (old) {
+         memorysafety::mark_destroyed(old);
+         delete old;
       }
+   }
+   /// Give up ownership without destroying the object
+   T* release() noexcept {
+      T* result = _ptr;
+      _ptr = nullptr;
+      return result;
+   }
+   /// Swap the content
+   void swap(ms_unique_ptr& o) noexcept { std::swap(_ptr, o._ptr); }
 
-      const_iterator& operator++() {
-         memorysafety::assert_spatial(iter != limit);
-         ++iter;
-         return *this;
-      }
-      const_iterator& operator+=(long step) {
-         memorysafety::assert_spatial((step >= 0) && (step < (limit - iter)));
-         iter += step;
-         return *this;
-      }
-      const_iterator operator+(long step) const {
-         const_iterator res = *this;
-         res += step;
-         return res;
-      }
-      char operator*() const {
-         memorysafety::assert_spatial(iter < limit);
-         memorysafety::validate(this);
-         return *iter;
+   /// Access
+   T* get() const noexcept { return _ptr; }
+   /// Access
+   T& operator*() const noexcept {
+      memorysafety::assert_spatial(_ptr);
+      return *_ptr;
+   }
+   /// Access
+   T* operator->() const noexcept {
+      memorysafety::assert_spatial(_ptr);
+      return _ptr;
+   }
+   /// A checked reference to the object that becomes invalid once the object is released
+   ref_wrapper<T> ref() const noexcept {
+      memorysafety::assert_spatial(_ptr);
+      return ref_wrapper<T>(*_ptr);
+   }
+   /// Do we own an object?
+   explicit operator bool() const noexcept { return _ptr; }
+
+   /// Comparison
+   template <class U>
+   bool operator==(const ms_unique_ptr<U>& o) const noexcept { return _ptr == o._ptr; }
+   /// Comparison
+   bool operator==(std::nullptr_t) const noexcept { return !_ptr; }
+};
+//---------------------------------------------------------------------------
+/// Create an object owned by an ms_unique_ptr
+template <class T, class... Args>
+ms_unique_ptr<T> make_ms_unique(Args&&... args) {
+   return ms_unique_ptr<T>(new T(std::forward<Args>(args)...));
+}
+//---------------------------------------------------------------------------
+namespace detail {
+/// The control block of ms_shared_ptr
+class ms_shared_control {
+   /// The number of shared pointers
+   std::atomic<unsigned long> uses{1};
+   /// The number of weak pointers, plus one as long as shared pointers exist
+   std::atomic<unsigned long> weaks{1};
+
+   protected:
+   /// Destroy the object
+   virtual void destroy_object() noexcept = 0;
+
+   public:
+   /// Destructor
+   virtual ~ms_shared_control() = default;
+
+   /// Add a shared pointer
+   void add_use() noexcept { uses.fetch_add(1, std::memory_order_relaxed); }
+   /// Add a shared pointer if the object still exists
+   bool try_add_use() noexcept {
+      auto current = uses.load(std::memory_order_relaxed);
+      while (current)
+         if (uses.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel, std::memory_order_relaxed)) return true;
+      return false;
+   }
+   /// Release a shared pointer. Destroys the object when the last one is gone
+   void release_use(const void* object) noexcept {
+      if (uses.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+         memorysafety::mark_destroyed(object);
+         destroy_object();
+         release_weak();
       }
+   }
+   /// Add a weak pointer
+   void add_weak() noexcept { weaks.fetch_add(1, std::memory_order_relaxed); }
+   /// Release a weak pointer
+   void release_weak() noexcept {
+      if (weaks.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+   }
+   /// The number of shared pointers
+   unsigned long use_count() const noexcept { return uses.load(std::memory_order_relaxed); }
+};
+/// A control block for an object that was allocated separately
+template <class T>
+class ms_shared_control_ptr final : public ms_shared_control {
+   /// The object
+   T* ptr;
 
-      bool operator==(const iterator& o) const { return iter == o.iter; }
-      bool operator!=(const iterator& o) const { return iter != o.iter; }
-      bool operator<(const iterator& o) const { return iter < o.iter; }
-      bool operator<=(const iterator& o) const { return iter <= o.iter; }
-      bool operator>(const iterator& o) const { return iter > o.iter; }
-      bool operator>=(const iterator& o) const { return iter >= o.iter; }
+   protected:
+   /// Destroy the object
+   void destroy_object() noexcept override { delete ptr; }
+
+   public:
+   /// Constructor
+   explicit ms_shared_control_ptr(T* ptr) noexcept : ptr(ptr) {}
+};
+/// A control block that contains the object itself
+template <class T>
+class ms_shared_control_inplace final : public ms_shared_control {
+   public:
+   /// The object
+   union {
+      T object;
    };
 
-   /// The data
-   char* _ptr;
-   /// Size and capacity
-   size_type _size, _capacity;
+   protected:
+   /// Destroy the object
+   void destroy_object() noexcept override { object.~T(); }
 
    public:
    /// Constructor
-   constexpr ms_string() : _ptr(nullptr), _size(0), _capacity(0) {}
-   /// Constructor from a C string
-   ms_string(const char* cstr) {
-      size_type len = 0;
-      while (cstr[len]) ++len;
-      if (len) {
-         _ptr = new char[len];
-         for (size_type index = 0; index < len; ++index)
-            _ptr[index] = cstr[index];
-      } else {
-         _ptr = nullptr;
-      }
-      _size = _capacity = len;
+   template <class... Args>
+   explicit ms_shared_control_inplace(Args&&... args) : object(std::forward<Args>(args)...) {}
+   /// Destructor. The object itself is destroyed by destroy_object
+   ~ms_shared_control_inplace() override {}
+};
+}
+//---------------------------------------------------------------------------
+template <class T>
+class ms_weak_ptr;
+//---------------------------------------------------------------------------
+/// A shared pointer whose pointee participates in existence tracking. References obtained
+/// via ref() become invalid when the last shared pointer releases the object. Like with
+/// ms_unique_ptr, access through the pointer itself needs no runtime lookup
+template <class T>
+class ms_shared_ptr {
+   /// The object
+   T* _ptr;
+   /// The control block
+   detail::ms_shared_control* _ctrl;
+
+   friend class ms_weak_ptr<T>;
+   template <class U, class... Args>
+   friend ms_shared_ptr<U> make_ms_shared(Args&&... args);
+
+   /// Constructor
+   ms_shared_ptr(T* ptr, detail::ms_shared_control* ctrl) noexcept : _ptr(ptr), _ctrl(ctrl) {}
+
+   public:
+   using element_type = T;
+
+   /// Constructor
+   constexpr ms_shared_ptr() noexcept : _ptr(nullptr), _ctrl(nullptr) {}
+   /// Constructor
+   constexpr ms_shared_ptr(std::nullptr_t) noexcept : _ptr(nullptr), _ctrl(nullptr) {}
+   /// Constructor. Takes ownership of the object
+   explicit ms_shared_ptr(T* ptr) : _ptr(ptr), _ctrl(ptr ? new detail::ms_shared_control_ptr<T>(ptr) : nullptr) {}
+   /// Constructor. Takes ownership of the object
+   ms_shared_ptr(ms_unique_ptr<T>&& o) : ms_shared_ptr(o.get()) { o.release(); }
+   /// Copy constructor
+   ms_shared_ptr(const ms_shared_ptr& o) noexcept : _ptr(o._ptr), _ctrl(o._ctrl) {
+      if (_ctrl) _ctrl->add_use();
    }
    /// Move constructor
-   ms_string(ms_string&& o) noexcept
-      : _ptr(o._ptr), _size(o._size), _capacity(o._capacity) {
-      memorysafety::mark_modified(&o);
+   ms_shared_ptr(ms_shared_ptr&& o) noexcept : _ptr(o._ptr), _ctrl(o._ctrl) {
       o._ptr = nullptr;
-      o._size = o._capacity = 0;
-   }
-   /// Copy constructor
-   ms_string(const ms_string& o)
-      : _size(o._size), _capacity(o._size) {
-      if (_size) {
-         _ptr = new char[_size];
-         for (size_type index = 0; index < _size; ++index)
-            _ptr[index] = o._ptr[index];
-      } else {
-         _ptr = nullptr;
-      }
+      o._ctrl = nullptr;
    }
    /// Destructor
-   ~ms_string() {
-      memorysafety::mark_destroyed(this);
-      delete[] _ptr;
-   }
+   ~ms_shared_ptr() { reset(); }
 
    /// Assignment
-   ms_string& operator=(const ms_string& o) {
-      if (this != &o) {
-         memorysafety::mark_modified(this);
-         delete[] _ptr;
-         _size = _capacity = o._size;
-         if (_size) {
-            _ptr = new char[_size];
-            for (size_type index = 0; index < _size; ++index)
-               _ptr[index] = o._ptr[index];
-         } else {
-            _ptr = nullptr;
-         }
-      }
+   ms_shared_ptr& operator=(const ms_shared_ptr& o) noexcept {
+      ms_shared_ptr(o).swap(*this);
       return *this;
    }
    /// Assignment
-   ms_string& operator=(ms_string&& o) {
-      if (this != &o) {
-         memorysafety::mark_modified(this);
-         memorysafety::mark_modified(&o);
-         delete[] _ptr;
-         _ptr = o._ptr;
-         _size = o._size;
-         _capacity = o._capacity;
-         o._ptr = nullptr;
-         o._size = o._capacity = 0;
-      }
+   ms_shared_ptr& operator=(ms_shared_ptr&& o) noexcept {
+      ms_shared_ptr(std::move(o)).swap(*this);
       return *this;
    }
 
-   /// Access
-   reference operator[](size_type pos) {
-      memorysafety::assert_spatial(pos < _size);
-      return reference(this, _ptr[pos]);
+   /// Release the object
+   void reset() noexcept {
+      if (_ctrl) {
+         auto ptr = _ptr;
+         auto ctrl = _ctrl;
+         _ptr = nullptr;
+         _ctrl = nullptr;
+         ctrl->release_use(ptr);
+      }
    }
-   /// Access
-   const_reference operator[](size_type pos) const {
+   /// Swap the content
+   void swap(ms_shared_ptr& o) noexcept {
+      std::swap(_ptr, o._ptr);
+      std::swap(_ctrl, o._ctrl);
+   }
+
+   /// Access
+   T* get() const noexcept { return _ptr; }
+   /// Access
+   T& operator*() const noexcept {
+      memorysafety::assert_spatial(_ptr);
+      return *_ptr;
+   }
+   /// Access
+   T* operator->() const noexcept {
+      memorysafety::assert_spatial(_ptr);
+      return _ptr;
+   }
+   /// A checked reference to the object that becomes invalid once the object is released
+   ref_wrapper<T> ref() const noexcept {
+      memorysafety::assert_spatial(_ptr);
+      return ref_wrapper<T>(*_ptr);
+   }
+   /// The number of shared pointers to the object
+   unsigned long use_count() const noexcept { return _ctrl ? _ctrl->use_count() : 0; }
+   /// Do we point to an object?
+   explicit operator bool() const noexcept { return _ptr; }
+
+   /// Comparison
+   bool operator==(const ms_shared_ptr& o) const noexcept { return _ptr == o._ptr; }
+   /// Comparison
+   bool operator==(std::nullptr_t) const noexcept { return !_ptr; }
+};
+//---------------------------------------------------------------------------
+/// Create an object owned by an ms_shared_ptr, using a single allocation
+template <class T, class... Args>
+ms_shared_ptr<T> make_ms_shared(Args&&... args) {
+   auto ctrl = new detail::ms_shared_control_inplace<T>(std::forward<Args>(args)...);
+   return ms_shared_ptr<T>(&ctrl->object, ctrl);
+}
+//---------------------------------------------------------------------------
+/// A weak pointer to an object owned by ms_shared_ptr
+template <class T>
+class ms_weak_ptr {
+   /// The object
+   T* _ptr;
+   /// The control block
+   detail::ms_shared_control* _ctrl;
+
+   public:
+   /// Constructor
+   constexpr ms_weak_ptr() noexcept : _ptr(nullptr), _ctrl(nullptr) {}
+   /// Constructor
+   ms_weak_ptr(const ms_shared_ptr<T>& o) noexcept : _ptr(o._ptr), _ctrl(o._ctrl) {
+      if (_ctrl) _ctrl->add_weak();
+   }
+   /// Copy constructor
+   ms_weak_ptr(const ms_weak_ptr& o) noexcept : _ptr(o._ptr), _ctrl(o._ctrl) {
+      if (_ctrl) _ctrl->add_weak();
+   }
+   /// Move constructor
+   ms_weak_ptr(ms_weak_ptr&& o) noexcept : _ptr(o._ptr), _ctrl(o._ctrl) {
+      o._ptr = nullptr;
+      o._ctrl = nullptr;
+   }
+   /// Destructor
+   ~ms_weak_ptr() { reset(); }
+
+   /// Assignment
+   ms_weak_ptr& operator=(const ms_weak_ptr& o) noexcept {
+      ms_weak_ptr(o).swap(*this);
+      return *this;
+   }
+   /// Assignment
+   ms_weak_ptr& operator=(ms_weak_ptr&& o) noexcept {
+      ms_weak_ptr(std::move(o)).swap(*this);
+      return *this;
+   }
+
+   /// Drop the reference
+   void reset() noexcept {
+      if (_ctrl) _ctrl->release_weak();
+      _ptr = nullptr;
+      _ctrl = nullptr;
+   }
+   /// Swap the content
+   void swap(ms_weak_ptr& o) noexcept {
+      std::swap(_ptr, o._ptr);
+      std::swap(_ctrl, o._ctrl);
+   }
+
+   /// Was the object destroyed?
+   bool expired() const noexcept { return !_ctrl || !_ctrl->use_count(); }
+   /// Get a shared pointer to the object, if it still exists
+   ms_shared_ptr<T> lock() const noexcept {
+      if (_ctrl && _ctrl->try_add_use()) return ms_shared_ptr<T>(_ptr, _ctrl);
+      return ms_shared_ptr<T>();
+   }
+};
+//---------------------------------------------------------------------------
+/// A frozen range of container elements for parallel processing. The container is validated once
+/// when the section is created, and it cannot be modified or destroyed while the section exists.
+/// This allows for handing out raw sub-ranges to worker threads (or to std::execution::par
+/// algorithms) that do not touch the runtime at all
+template <class T>
+class parallel_section {
+   /// The container
+   const void* _container;
+   /// The elements
+   T *_begin, *_end;
+
+   public:
+   /// Constructor
+   parallel_section(const void* container, T* begin, T* end) noexcept : _container(container), _begin(begin), _end(end) {
+      memorysafety::validate(container);
+      memorysafety::freeze(container);
+   }
+   /// Destructor
+   ~parallel_section() { memorysafety::unfreeze(_container); }
+
+   parallel_section(const parallel_section&) = delete;
+   parallel_section& operator=(const parallel_section&) = delete;
+
+   /// Raw access to the elements
+   T* begin() const noexcept { return _begin; }
+   /// Raw access to the elements
+   T* end() const noexcept { return _end; }
+   /// The number of elements
+   std::size_t size() const noexcept { return _end - _begin; }
+
+   /// The sub-range of a worker when splitting the section into the given number of parts
+   std::span<T> chunk(std::size_t worker, std::size_t workers) const noexcept {
+      memorysafety::assert_spatial(worker < workers);
+      std::size_t s = size(), from = s * worker / workers, to = s * (worker + 1) / workers;
+      return std::span<T>(_begin + from, _begin + to);
+   }
+};
+//---------------------------------------------------------------------------
+namespace detail {
+//---------------------------------------------------------------------------
+/// The maximum number of characters produced by std::to_chars for a type. Floating point numbers use the shortest representation, which is never longer than the scientific one
+template <class T>
+constexpr unsigned long max_chars() {
+   if constexpr (std::is_integral_v<T>)
+      return std::numeric_limits<T>::digits10 + 2;
+   else
+      return std::numeric_limits<T>::max_digits10 + 8;
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+/// A read-only view of characters owned by another object. Depending on the owner, the view
+/// depends on the content (e.g., of an ms_string) or on the existence (e.g., of a chunk
+/// of an ms_string_builder) of the owner. Copies carry over all dependencies
+class ms_string_view {
+   public:
+   using value_type = char;
+   using size_type = unsigned long;
+   using difference_type = long;
+
+   static constexpr size_type npos = ~static_cast<size_type>(0);
+
+   private:
+   /// The characters
+   const char* _ptr;
+   /// The length
+   size_type _size;
+   /// The owning thread
+   [[no_unique_address]] owner_tag _owner;
+
+   public:
+   /// Constructor
+   constexpr ms_string_view() noexcept : _ptr(nullptr), _size(0) {}
+   /// Constructor. Depends on the content or on the existence of the owner
+   ms_string_view(const void* owner, bool content, const char* ptr, size_type size) noexcept : _ptr(ptr), _size(size) {
+      if (content)
+         memorysafety::add_content_dependency(this, owner);
+      else
+         memorysafety::add_dependency(this, owner);
+   }
+   /// Copy constructor
+   ms_string_view(const ms_string_view& o) noexcept : _ptr(o._ptr), _size(o._size) { memorysafety::propagate_dependencies(this, &o); }
+   /// Destructor
+   ~ms_string_view() { memorysafety::mark_destroyed(this); }
+
+   /// Assignment
+   ms_string_view& operator=(const ms_string_view& o) noexcept {
+      if (this != &o) {
+         memorysafety::reset(this);
+         _ptr = o._ptr;
+         _size = o._size;
+         memorysafety::propagate_dependencies(this, &o);
+      }
+      return *this;
+   }
+
+   /// Empty?
+   bool empty() const { return !_size; }
+   /// Size
+   size_type size() const { return _size; }
+   /// Size
+   size_type length() const { return _size; }
+
+   /// Access
+   char operator[](size_type pos) const {
       memorysafety::assert_spatial(pos < _size);
-      return const_reference(this, _ptr[pos]);
+      _owner.validate(this);
+      return _ptr[pos];
+   }
+   /// Access
+   char front() const { return (*this)[0]; }
+   /// Access
+   char back() const { return (*this)[_size - 1]; }
+
+   /// Access to all characters with a single check. The result must not outlive the view
+   std::span<const char> span() const {
+      _owner.validate(this);
+      return std::span<const char>(_ptr, _size);
+   }
+
+   /// A part of the view
+   ms_string_view substr(size_type pos, size_type count = npos) const {
+      memorysafety::assert_spatial(pos <= _size);
+      ms_string_view result(*this);
+      result._ptr += pos;
+      result._size = ((_size - pos) < count) ? (_size - pos) : count;
+      return result;
+   }
+   /// Parse a number using std::from_chars. Succeeds only if the whole view is consumed
+   template <class T>
+      requires(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>)
+   bool parse(T& value) const {
+      auto s = span();
+      auto result = std::from_chars(s.data(), s.data() + s.size(), value);
+      return (result.ec == std::errc()) && (result.ptr == s.data() + s.size());
+   }
+   /// Find a character
+   size_type find(char c, size_type pos = 0) const {
+      if (pos >= _size) return npos;
+      _owner.validate(this);
+      auto hit = static_cast<const char*>(std::memchr(_ptr + pos, c, _size - pos));
+      return hit ? (hit - _ptr) : npos;
+   }
+
+   /// Comparison
+   bool operator==(const ms_string_view& o) const {
+      _owner.validate(this);
+      memorysafety::validate(&o);
+      return (_size == o._size) && ((!_size) || (std::memcmp(_ptr, o._ptr, _size) == 0));
+   }
+};
+//---------------------------------------------------------------------------
+/// A simple string implementation that demonstrates safety primitives
+class ms_string {
+   public:
+   using value_type = char;
+   using size_type = unsigned long;
+   using difference_type = long;
+   using reference = inner_ref_wrapper<char>;
+   using const_reference = inner_ref_wrapper<const char>;
+
+   static constexpr size_type npos = ~static_cast<size_type>(0);
+
+   class const_iterator;
+
+   /// An iterator. Models a contiguous iterator, all movements are checked against the bounds of the string
+   class iterator {
+      public:
+      using iterator_category = std::random_access_iterator_tag;
+      using iterator_concept = std::contiguous_iterator_tag;
+      using value_type = char;
+      using difference_type = long;
+      using pointer = char*;
+      using reference = char&;
+
+      private:
+      char *start, *iter, *limit;
+      /// The owning thread
+      [[no_unique_address]] owner_tag _owner;
+
+      friend class ms_string;
+      friend class const_iterator;
+
+      iterator(ms_string* outer, char* iter, char* limit) noexcept : start(outer->_ptr), iter(iter), limit(limit) {
+         memorysafety::add_content_dependency(this, outer);
+      }
+
+      public:
+      constexpr iterator() noexcept : start(nullptr), iter(nullptr), limit(nullptr) {}
+      iterator(const iterator& o) noexcept : start(o.start), iter(o.iter), limit(o.limit) { memorysafety::propagate_content(this, &o); }
+      ~iterator() { memorysafety::mark_destroyed(this); }
+
+      iterator& operator=(const iterator& o) noexcept {
+         if (this != &o) {
+            memorysafety::reset(this);
+            start = o.start;
+            iter = o.iter;
+            limit = o.limit;
+            memorysafety::propagate_content(this, &o);
+         }
+         return *this;
+      }
+
+      iterator& operator++() {
+         memorysafety::assert_spatial(iter != limit);
+         ++iter;
+         return *this;
+      }
+      iterator operator++(int) {
+         iterator res = *this;
+         ++*this;
+         return res;
+      }
+      iterator& operator--() {
+         memorysafety::assert_spatial(iter != start);
+         --iter;
+         return *this;
+      }
+      iterator operator--(int) {
+         iterator res = *this;
+         --*this;
+         return res;
+      }
+      iterator& operator+=(long step) {
+         memorysafety::assert_spatial((step >= (start - iter)) && (step <= (limit - iter)));
+         iter += step;
+         return *this;
+      }
+      iterator& operator-=(long step) {
+         memorysafety::assert_spatial((step >= (iter - limit)) && (step <= (iter - start)));
+         iter -= step;
+         return *this;
+      }
+      iterator operator+(long step) const {
+         iterator res = *this;
+         res += step;
+         return res;
+      }
+      friend iterator operator+(long step, const iterator& o) { return o + step; }
+      iterator operator-(long step) const {
+         iterator res = *this;
+         res -= step;
+         return res;
+      }
+      long operator-(const iterator& o) const {
+         memorysafety::assert_spatial(start == o.start);
+         return iter - o.iter;
+      }
+      char& operator*() const {
+         memorysafety::assert_spatial((iter >= start) && (iter < limit));
+         _owner.validate(this);
+         return *iter;
+      }
+      char& operator[](long pos) const {
+         memorysafety::assert_spatial((pos >= (start - iter)) && (pos < (limit - iter)));
+         _owner.validate(this);
+         return iter[pos];
+      }
+      /// Raw pointer access, used by std::to_address. Not bounds checked, as the end position is a valid result
+      char* operator->() const {
+         _owner.validate(this);
+         return iter;
+      }
+
+      bool operator==(const iterator& o) const { return iter == o.iter; }
+      std::strong_ordering operator<=>(const iterator& o) const { return iter <=> o.iter; }
+   };
+   /// A const iterator
+   class const_iterator {
+      public:
+      using iterator_category = std::random_access_iterator_tag;
+      using iterator_concept = std::contiguous_iterator_tag;
+      using value_type = char;
+      using difference_type = long;
+      using pointer = const char*;
+      using reference = const char&;
+
+      private:
+      const char *start, *iter, *limit;
+      /// The owning thread
+      [[no_unique_address]] owner_tag _owner;
+
+      friend class ms_string;
+
+      const_iterator(const ms_string* outer, const char* iter, const char* limit) noexcept : start(outer->_ptr), iter(iter), limit(limit) {
+         memorysafety::add_content_dependency(this, outer);
+      }
+
+      public:
+      constexpr const_iterator() noexcept : start(nullptr), iter(nullptr), limit(nullptr) {}
+      const_iterator(const const_iterator& o) noexcept : start(o.start), iter(o.iter), limit(o.limit) { memorysafety::propagate_content(this, &o); }
+      const_iterator(const iterator& o) noexcept : start(o.start), iter(o.iter), limit(o.limit) { memorysafety::propagate_content(this, &o); }
+      ~const_iterator() { memorysafety::mark_destroyed(this); }
+
+      const_iterator& operator=(const const_iterator& o) noexcept {
+         if (this != &o) {
+            memorysafety::reset(this);
+            start = o.start;
+            iter = o.iter;
+            limit = o.limit;
+            memorysafety::propagate_content(this, &o);
+         }
+         return *this;
+      }
+
+      const_iterator& operator++() {
+         memorysafety::assert_spatial(iter != limit);
+         ++iter;
+         return *this;
+      }
+      const_iterator operator++(int) {
+         const_iterator res = *this;
+         ++*this;
+         return res;
+      }
+      const_iterator& operator--() {
+         memorysafety::assert_spatial(iter != start);
+         --iter;
+         return *this;
+      }
+      const_iterator operator--(int) {
+         const_iterator res = *this;
+         --*this;
+         return res;
+      }
+      const_iterator& operator+=(long step) {
+         memorysafety::assert_spatial((step >= (start - iter)) && (step <= (limit - iter)));
+         iter += step;
+         return *this;
+      }
+      const_iterator& operator-=(long step) {
+         memorysafety::assert_spatial((step >= (iter - limit)) && (step <= (iter - start)));
+         iter -= step;
+         return *this;
+      }
+      const_iterator operator+(long step) const {
+         const_iterator res = *this;
+         res += step;
+         return res;
+      }
+      friend const_iterator operator+(long step, const const_iterator& o) { return o + step; }
+      const_iterator operator-(long step) const {
+         const_iterator res = *this;
+         res -= step;
+         return res;
+      }
+      long operator-(const const_iterator& o) const {
+         memorysafety::assert_spatial(start == o.start);
+         return iter - o.iter;
+      }
+      const char& operator*() const {
+         memorysafety::assert_spatial((iter >= start) && (iter < limit));
+         _owner.validate(this);
+         return *iter;
+      }
+      const char& operator[](long pos) const {
+         memorysafety::assert_spatial((pos >= (start - iter)) && (pos < (limit - iter)));
+         _owner.validate(this);
+         return iter[pos];
+      }
+      /// Raw pointer access, used by std::to_address. Not bounds checked, as the end position is a valid result
+      const char* operator->() const {
+         _owner.validate(this);
+         return iter;
+      }
+
+      bool operator==(const const_iterator& o) const { return iter == o.iter; }
+      std::strong_ordering operator<=>(const const_iterator& o) const { return iter <=> o.iter; }
+   };
+
+   /// The data
+   char* _ptr;
+   /// Size and capacity
+   size_type _size, _capacity;
+   /// The owning thread
+   [[no_unique_address]] owner_tag _owner;
+
+   private:
+   /// Check the owning thread before handing out references into the string
+   const ms_string* owned() const {
+      _owner.check(this);
+      return this;
+   }
+   /// Check the owning thread before handing out references into the string
+   ms_string* owned() {
+      _owner.check(this);
+      return this;
+   }
+
+   public:
+   /// Constructor
+   constexpr ms_string() : _ptr(nullptr), _size(0), _capacity(0) {}
+   /// Constructor from a C string
+   ms_string(const char* cstr) {
+      size_type len = 0;
+      while (cstr[len]) ++len;
+      if (len) {
+         _ptr = new char[len];
+         for (size_type index = 0; index < len; ++index)
+            _ptr[index] = cstr[index];
+      } else {
+         _ptr = nullptr;
+      }
+      _size = _capacity = len;
+   }
+   /// Move constructor
+   ms_string(ms_string&& o) noexcept
+      : _ptr(o._ptr), _size(o._size), _capacity(o._capacity) {
+      memorysafety::mark_modified(&o);
+      o._ptr = nullptr;
+      o._size = o._capacity = 0;
+   }
+   /// Constructor from a view
+   explicit ms_string(const ms_string_view& v) : _ptr(nullptr), _size(0), _capacity(0) {
+      auto s = v.span();
+      if (!s.empty()) {
+         _ptr = new char[s.size()];
+         std::memcpy(_ptr, s.data(), s.size());
+         _size = _capacity = s.size();
+      }
+   }
+   /// Copy constructor
+   ms_string(const ms_string& o)
+      : _size(o._size), _capacity(o._size) {
+      if (_size) {
+         _ptr = new char[_size];
+         for (size_type index = 0; index < _size; ++index)
+            _ptr[index] = o._ptr[index];
+      } else {
+         _ptr = nullptr;
+      }
+   }
+   /// Destructor
+   ~ms_string() {
+      memorysafety::mark_destroyed(this);
+      delete[] _ptr;
+   }
+
+   /// Assignment
+   ms_string& operator=(const ms_string& o) {
+      if (this != &o) {
+         _owner.check(this);
+         memorysafety::mark_modified(this);
+         delete[] _ptr;
+         _size = _capacity = o._size;
+         if (_size) {
+            _ptr = new char[_size];
+            for (size_type index = 0; index < _size; ++index)
+               _ptr[index] = o._ptr[index];
+         } else {
+            _ptr = nullptr;
+         }
+      }
+      return *this;
+   }
+   /// Assignment
+   ms_string& operator=(ms_string&& o) {
+      if (this != &o) {
+         _owner.check(this);
+         memorysafety::mark_modified(this);
+         memorysafety::mark_modified(&o);
+         delete[] _ptr;
+         _ptr = o._ptr;
+         _size = o._size;
+         _capacity = o._capacity;
+         o._ptr = nullptr;
+         o._size = o._capacity = 0;
+      }
+      return *this;
+   }
+
+   /// Access
+   reference operator[](size_type pos) {
+      memorysafety::assert_spatial(pos < _size);
+      return reference(owned(), _ptr[pos]);
+   }
+   /// Access
+   const_reference operator[](size_type pos) const {
+      memorysafety::assert_spatial(pos < _size);
+      return const_reference(owned(), _ptr[pos]);
+   }
+   /// Access
+   reference front() {
+      memorysafety::assert_spatial(_size > 0);
+      return reference(owned(), _ptr[0]);
+   }
+   /// Access
+   const_reference front() const {
+      memorysafety::assert_spatial(_size > 0);
+      return const_reference(owned(), _ptr[0]);
+   }
+   /// Access
+   reference back() {
+      memorysafety::assert_spatial(_size > 0);
+      return reference(owned(), _ptr[_size - 1]);
+   }
+   /// Access
+   const_reference back() const {
+      memorysafety::assert_spatial(_size > 0);
+      return const_reference(owned(), _ptr[_size - 1]);
+   }
+   /// Access the raw data. TODO result is currently unsafe, we need a checking wrapper here
+   const char* data() const { return _ptr; }
+   /// A view of the string. The view becomes invalid when the string is modified
+   ms_string_view view() const { return ms_string_view(owned(), true, _ptr, _size); }
+   /// Allow access from all threads. Accesses must be synchronized externally, e.g., by locked
+   void share() {
+      _owner.share();
+      memorysafety::share(this);
+   }
+   /// Hand the string to another thread. Existing iterators and references keep their owner
+   void transfer(unsigned long thread) {
+      _owner.transfer(thread);
+      memorysafety::transfer(this, thread);
+   }
+
+   /// Iterator
+   iterator begin() { return iterator(owned(), _ptr, _ptr + _size); }
+   /// Iterator
+   const_iterator begin() const { return const_iterator(owned(), _ptr, _ptr + _size); }
+   /// Iterator
+   const_iterator cbegin() { return const_iterator(owned(), _ptr, _ptr + _size); }
+   /// Iterator
+   iterator end() { return iterator(owned(), _ptr + _size, _ptr + _size); }
+   /// Iterator
+   const_iterator end() const { return const_iterator(owned(), _ptr + _size, _ptr + _size); }
+   /// Iterator
+   const_iterator cend() { return const_iterator(owned(), _ptr + _size, _ptr + _size); }
+   /// Freeze the string for parallel processing
+   parallel_section<char> parallel() { return parallel_section<char>(this, _ptr, _ptr + _size); }
+   /// Freeze the string for parallel processing
+   parallel_section<const char> parallel() const { return parallel_section<const char>(this, _ptr, _ptr + _size); }
+   /// Apply a function to all characters. The string is checked once and frozen while iterating, modifications within the function are reported as violations
+   template <class F>
+   void for_each(F&& f) {
+      parallel_section<char> section(this, _ptr, _ptr + _size);
+      for (char& c : section) f(c);
+   }
+   /// Apply a function to all characters. The string is checked once and frozen while iterating, modifications within the function are reported as violations
+   template <class F>
+   void for_each(F&& f) const {
+      parallel_section<const char> section(this, _ptr, _ptr + _size);
+      for (const char& c : section) f(c);
+   }
+
+   /// Empty?
+   bool empty() const { return !_size; }
+   /// Size
+   size_type size() const { return _size; }
+   /// Size
+   size_type length() const { return _size; }
+   /// Capacity
+   size_type capacity() const { return _capacity; }
+   /// Make sure we have enough space
+   void reserve(size_type nc) {
+      _owner.check(this);
+      memorysafety::mark_modified(this);
+      if (nc > _capacity) {
+         size_type nc2 = _capacity + (_capacity / 8);
+         if (nc2 > nc) nc = nc2;
+         char* np = new char[nc];
+         for (size_type index = 0; index < _size; ++index) np[index] = _ptr[index];
+         delete[] _ptr;
+         _ptr = np;
+         _capacity = nc;
+      }
+   }
+
+   // Clear the contents
+   void clear() {
+      _owner.check(this);
+      memorysafety::mark_modified(this);
+      _size = 0;
+   }
+   /// Erase characters
+   ms_string& erase(size_type index = 0, size_type count = npos) {
+      _owner.check(this);
+      memorysafety::mark_modified(this);
+      if (index < _size) {
+         if (count < (_size - index)) {
+            for (size_type index = 0, limit = _size - index - count; index != limit; ++index)
+               _ptr[index] = _ptr[index + count];
+            _size -= count;
+         } else {
+            _size = index;
+         }
+      }
+      return *this;
+   }
+   /// Erase a character
+   iterator erase(iterator iter) {
+      memorysafety::validate(&iter);
+      memorysafety::assert_spatial((iter.iter >= _ptr) && (iter.iter <= _ptr + _size));
+      size_type pos = iter.iter - _ptr;
+      erase(pos, 1);
+      return iterator(owned(), _ptr + ((pos < _size) ? pos : _size), _ptr + _size);
+   }
+   /// Erase a range of characters
+   iterator erase(iterator first, iterator last) {
+      memorysafety::validate(&first);
+      memorysafety::validate(&last);
+      memorysafety::assert_spatial((first.iter >= _ptr) && (last.iter >= first.iter) && (last.iter <= _ptr + _size));
+      size_type pos = first.iter - _ptr, count = last.iter - first.iter;
+      erase(pos, count);
+      return iterator(owned(), _ptr + ((pos < _size) ? pos : _size), _ptr + _size);
+   }
+
+   /// Append up to maxCount characters that are written directly into the string by f(char* out), which returns the number of characters written. Marks the string as modified only once
+   template <class F>
+   void append_into(size_type maxCount, F&& f) {
+      // Reserve marks as modified
+      reserve(_size + maxCount);
+
+      // Check for numeric overflows
+      memorysafety::assert_spatial((_size + maxCount >= _size) && (_size + maxCount <= _capacity));
+
+      size_type written = f(_ptr + _size);
+      memorysafety::assert_spatial(written <= maxCount);
+      _size += written;
+   }
+   /// Append characters
+   ms_string& append(const char* data, size_type count) {
+      append_into(count, [&](char* out) {
+         if (count) std::memcpy(out, data, count);
+         return count;
+      });
+      return *this;
+   }
+   /// Append a view
+   ms_string& append(const ms_string_view& v) {
+      auto s = v.span();
+      return append(s.data(), s.size());
+   }
+   /// Append a number using std::to_chars
+   template <class T>
+      requires(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>)
+   ms_string& append_number(T value) {
+      constexpr size_type maxCount = detail::max_chars<T>();
+      append_into(maxCount, [&](char* out) { return std::to_chars(out, out + maxCount, value).ptr - out; });
+      return *this;
+   }
+   /// Append a formatted message. Each "{}" is replaced by the next argument, "{{" and "}}" produce single braces. Marks the string as modified only once
+   template <class... Args>
+   ms_string& append_format(const char* fmt, const Args&... args);
+   /// Comparison
+   bool operator==(const ms_string& o) const {
+      _owner.validate(this);
+      memorysafety::validate(&o);
+      return (_size == o._size) && ((!_size) || (std::memcmp(_ptr, o._ptr, _size) == 0));
+   }
+   /// Comparison
+   bool operator==(const ms_string_view& o) const {
+      _owner.validate(this);
+      auto s = o.span();
+      return (_size == s.size()) && ((!_size) || (std::memcmp(_ptr, s.data(), _size) == 0));
+   }
+   /// Parse a number using std::from_chars. Succeeds only if the whole string is consumed
+   template <class T>
+      requires(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>)
+   bool parse(T& value) const {
+      _owner.validate(this);
+      auto result = std::from_chars(_ptr, _ptr + _size, value);
+      return (result.ec == std::errc()) && (result.ptr == _ptr + _size);
+   }
+   /// Append a character
+   void push_back(char c) {
+      // Reserve marks as modified
+      reserve(_size + 1);
+
+      // Check for numeric overflows
+      memorysafety::assert_spatial(_size < _capacity);
+
+      _ptr[_size++] = c;
+   }
+   /// Append
+   ms_string& operator+=(char c) {
+      push_back(c);
+      return *this;
+   }
+   /// Append
+   ms_string& operator+=(const ms_string& o) {
+      memorysafety::assert_spatial(this != &o);
+
+      reserve(_size + o._size);
+
+      // Check for numeric overflows
+      memorysafety::assert_spatial((_size < _capacity) && (o._size < _capacity));
+
+      for (size_type index = 0; index != o._size; ++index)
+         _ptr[_size++] = o._ptr[index];
+      return *this;
+   }
+
+   /// Change the string size
+   void resize(size_type ns, char c = '\0') {
+      _owner.check(this);
+      memorysafety::mark_modified(this);
+
+      if (ns < _size) {
+         _size = ns;
+      } else if (ns > _size) {
+         reserve(ns);
+         memorysafety::assert_spatial(ns <= _capacity);
+         while (_size < ns) _ptr[_size++] = c;
+      }
+   }
+
+   /// Swap the content
+   void swap(ms_string& o) noexcept {
+      if (this != &o) {
+         _owner.check(this);
+         memorysafety::mark_modified(this);
+         memorysafety::mark_modified(&o);
+
+         {
+            auto tmp = _ptr;
+            _ptr = o._ptr;
+            o._ptr = tmp;
+         }
+         {
+            auto tmp = _size;
+            _size = o._size;
+            o._size = tmp;
+         }
+         {
+            auto tmp = _capacity;
+            _capacity = o._capacity;
+            o._capacity = tmp;
+         }
+      }
+   }
+};
+//---------------------------------------------------------------------------
+static_assert(std::contiguous_iterator<ms_string::iterator>);
+static_assert(std::contiguous_iterator<ms_string::const_iterator>);
+//---------------------------------------------------------------------------
+namespace detail {
+//---------------------------------------------------------------------------
+/// The characters of a string. The result must not outlive the string
+inline std::span<const char> string_span(const char* s) { return {s, std::strlen(s)}; }
+inline std::span<const char> string_span(const ms_string_view& v) { return v.span(); }
+inline std::span<const char> string_span(const ms_string& s) {
+   memorysafety::validate(&s);
+   return {s._ptr, s._size};
+}
+/// The characters of a key in a comparison. Strings own their characters and were validated when the key was hashed or
+/// inserted, views are validated, as their target may have been destroyed while the view was stored
+inline std::span<const char> key_span(const char* s) noexcept { return {s, std::strlen(s)}; }
+inline std::span<const char> key_span(const ms_string_view& v) { return v.span(); }
+inline std::span<const char> key_span(const ms_string& s) noexcept { return {s._ptr, s._size}; }
+//---------------------------------------------------------------------------
+/// Prepare a format argument. Strings and views are accessed only after the target has been reserved, as they might alias it
+inline std::span<const char> format_prepare(const char* s) { return string_span(s); }
+inline const ms_string_view* format_prepare(const ms_string_view& v) { return &v; }
+inline const ms_string* format_prepare(const ms_string& s) { return &s; }
+inline std::span<const char> format_prepare(bool b) { return b ? std::span<const char>("true", 4) : std::span<const char>("false", 5); }
+inline char format_prepare(char c) { return c; }
+template <class T>
+   requires(std::is_arithmetic_v<T>)
+T format_prepare(T value) { return value; }
+//---------------------------------------------------------------------------
+/// The maximum size of a formatted argument
+inline unsigned long format_size(std::span<const char> s) { return s.size(); }
+inline unsigned long format_size(const ms_string_view* v) { return v->size(); }
+inline unsigned long format_size(const ms_string* s) { return s->size(); }
+inline unsigned long format_size(char) { return 1; }
+template <class T>
+unsigned long format_size(T) { return max_chars<T>(); }
+//---------------------------------------------------------------------------
+/// Write a formatted argument
+inline char* format_write(char* out, std::span<const char> s) {
+   if (!s.empty()) std::memcpy(out, s.data(), s.size());
+   return out + s.size();
+}
+inline char* format_write(char* out, const ms_string_view* v) { return format_write(out, string_span(*v)); }
+inline char* format_write(char* out, const ms_string* s) { return format_write(out, string_span(*s)); }
+inline char* format_write(char* out, char c) {
+   *out = c;
+   return out + 1;
+}
+template <class T>
+char* format_write(char* out, T value) { return std::to_chars(out, out + max_chars<T>(), value).ptr; }
+//---------------------------------------------------------------------------
+/// Write a format string, replacing placeholders with arguments. Surplus placeholders are written as they are
+template <class... Args>
+char* format_to(char* out, const char* fmt, unsigned long fmtLen, const Args&... args) {
+   const char *iter = fmt, *limit = fmt + fmtLen;
+   [[maybe_unused]] auto literal = [&]() {
+      while (iter != limit) {
+         char c = *(iter++);
+         if (((c == '{') || (c == '}')) && (iter != limit) && (*iter == c)) {
+            ++iter;
+         } else if ((c == '{') && (iter != limit) && (*iter == '}')) {
+            ++iter;
+            return true;
+         }
+         *(out++) = c;
+      }
+      return false;
+   };
+   ((literal() ? (out = format_write(out, args)) : out), ...);
+   while (iter != limit) {
+      char c = *(iter++);
+      if (((c == '{') || (c == '}')) && (iter != limit) && (*iter == c)) ++iter;
+      *(out++) = c;
+   }
+   return out;
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+template <class... Args>
+ms_string& ms_string::append_format(const char* fmt, const Args&... args) {
+   auto prepared = std::make_tuple(detail::format_prepare(args)...);
+   size_type fmtLen = std::strlen(fmt);
+   size_type maxCount = std::apply([&](const auto&... p) { return (fmtLen + ... + detail::format_size(p)); }, prepared);
+   append_into(maxCount, [&](char* out) {
+      return std::apply([&](const auto&... p) { return detail::format_to(out, fmt, fmtLen, p...); }, prepared) - out;
+   });
+   return *this;
+}
+//---------------------------------------------------------------------------
+/// Build a formatted message
+template <class... Args>
+ms_string ms_format(const char* fmt, const Args&... args) {
+   ms_string result;
+   result.append_format(fmt, args...);
+   return result;
+}
+//---------------------------------------------------------------------------
+namespace detail {
+//---------------------------------------------------------------------------
+/// Multiply and fold the 128 bit product
+inline std::uint64_t hash_mix(std::uint64_t a, std::uint64_t b) {
+   __uint128_t r = static_cast<__uint128_t>(a) * b;
+   return static_cast<std::uint64_t>(r) ^ static_cast<std::uint64_t>(r >> 64);
+}
+//---------------------------------------------------------------------------
+/// Read 8 bytes
+inline std::uint64_t hash_read8(const char* p) {
+   std::uint64_t v;
+   std::memcpy(&v, p, 8);
+   return v;
+}
+//---------------------------------------------------------------------------
+/// Read 4 bytes
+inline std::uint64_t hash_read4(const char* p) {
+   std::uint32_t v;
+   std::memcpy(&v, p, 4);
+   return v;
+}
+//---------------------------------------------------------------------------
+/// Hash a sequence of bytes. Uses 128 bit multiplications in the style of wyhash, long inputs are processed in three independent lanes of 16 bytes each
+inline std::size_t hash_bytes(const char* p, std::size_t len) {
+   constexpr std::uint64_t s0 = 0xa0761d6478bd642full, s1 = 0xe7037ed1a0b428dbull, s2 = 0x8ebc6af09c88c6e3ull, s3 = 0x589965cc75374cc3ull;
+   std::uint64_t seed = hash_mix(s0, s1), a, b;
+   if (len <= 16) {
+      if (len >= 4) {
+         std::size_t shift = (len >> 3) << 2;
+         a = (hash_read4(p) << 32) | hash_read4(p + shift);
+         b = (hash_read4(p + len - 4) << 32) | hash_read4(p + len - 4 - shift);
+      } else if (len) {
+         a = (static_cast<std::uint64_t>(static_cast<unsigned char>(p[0])) << 16) | (static_cast<std::uint64_t>(static_cast<unsigned char>(p[len >> 1])) << 8) | static_cast<unsigned char>(p[len - 1]);
+         b = 0;
+      } else {
+         a = b = 0;
+      }
+   } else {
+      std::size_t i = len;
+      if (i > 48) {
+         std::uint64_t seed1 = seed, seed2 = seed;
+         do {
+            seed = hash_mix(hash_read8(p) ^ s1, hash_read8(p + 8) ^ seed);
+            seed1 = hash_mix(hash_read8(p + 16) ^ s2, hash_read8(p + 24) ^ seed1);
+            seed2 = hash_mix(hash_read8(p + 32) ^ s3, hash_read8(p + 40) ^ seed2);
+            p += 48;
+            i -= 48;
+         } while (i > 48);
+         seed ^= seed1 ^ seed2;
+      }
+      while (i > 16) {
+         seed = hash_mix(hash_read8(p) ^ s1, hash_read8(p + 8) ^ seed);
+         p += 16;
+         i -= 16;
+      }
+      a = hash_read8(p + i - 16);
+      b = hash_read8(p + i - 8);
+   }
+   __uint128_t r = static_cast<__uint128_t>(a ^ s1) * (b ^ seed);
+   return hash_mix(static_cast<std::uint64_t>(r) ^ s0 ^ len, static_cast<std::uint64_t>(r >> 64) ^ s1);
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+/// A hash function for strings. Validates once and hashes the raw characters. Transparent,
+/// i.e., ms_string_view and C strings can be used to probe maps with ms_string keys
+struct ms_string_hash {
+   using is_transparent = void;
+   /// The result is well mixed, ms_hash_map does not have to mix it again
+   using is_avalanching = void;
+
+   template <class T>
+   std::size_t operator()(const T& s) const {
+      auto chars = detail::string_span(s);
+      return detail::hash_bytes(chars.data(), chars.size());
+   }
+};
+//---------------------------------------------------------------------------
+/// A transparent comparison for strings. Strings are compared without validating them again, a lookup validates its key
+/// once when hashing it. Views are validated at every comparison, so stored views whose target is gone are reported
+struct ms_string_equal {
+   using is_transparent = void;
+
+   template <class A, class B>
+   bool operator()(const A& a, const B& b) const {
+      auto x = detail::key_span(a), y = detail::key_span(b);
+      return (x.size() == y.size()) && (x.empty() || (std::memcmp(x.data(), y.data(), x.size()) == 0));
+   }
+};
+//---------------------------------------------------------------------------
+namespace std {
+//---------------------------------------------------------------------------
+template <>
+struct hash<ms_string> : ms_string_hash {};
+//---------------------------------------------------------------------------
+template <>
+struct hash<ms_string_view> : ms_string_hash {};
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+/// Write a string
+template <class Traits>
+std::basic_ostream<char, Traits>& operator<<(std::basic_ostream<char, Traits>& out, const ms_string_view& v) {
+   auto s = v.span();
+   return out.write(s.data(), s.size());
+}
+//---------------------------------------------------------------------------
+/// Write a string
+template <class Traits>
+std::basic_ostream<char, Traits>& operator<<(std::basic_ostream<char, Traits>& out, const ms_string& s) {
+   return out << s.view();
+}
+//---------------------------------------------------------------------------
+/// Read a whitespace delimited word. Characters are written directly into the string in chunks
+template <class Traits>
+std::basic_istream<char, Traits>& operator>>(std::basic_istream<char, Traits>& in, ms_string& str) {
+   typename std::basic_istream<char, Traits>::sentry sentry(in);
+   if (!sentry) return in;
+
+   auto isSpace = [](int c) { return (c == ' ') || ((c >= '\t') && (c <= '\r')); };
+   auto buf = in.rdbuf();
+   bool done = false, extracted = false;
+   str.clear();
+   while (!done) {
+      ms_string::size_type chunk = (str.size() < 64) ? 64 : str.size();
+      str.append_into(chunk, [&](char* out) {
+         ms_string::size_type written = 0;
+         while (written < chunk) {
+            auto c = buf->sgetc();
+            if (Traits::eq_int_type(c, Traits::eof())) {
+               in.setstate(std::ios_base::eofbit);
+               done = true;
+               break;
+            }
+            if (isSpace(c)) {
+               done = true;
+               break;
+            }
+            out[written++] = Traits::to_char_type(c);
+            buf->sbumpc();
+         }
+         extracted |= written;
+         return written;
+      });
+   }
+   in.width(0);
+   if (!extracted) in.setstate(std::ios_base::failbit);
+   return in;
+}
+//---------------------------------------------------------------------------
+/// Read a line. The characters are read directly into the string storage with a single mark_modified per chunk
+template <class Traits>
+std::basic_istream<char, Traits>& getline(std::basic_istream<char, Traits>& in, ms_string& str, char delimiter = '\n') {
+   bool done = false, extracted = false;
+   // Reuse the buffer. Clearing checks the owner and invalidates views and iterators
+   str.clear();
+   while (!done) {
+      // The chunk includes room for the terminating null character written by istream::getline
+      ms_string::size_type chunk = str.capacity() - str.size();
+      if (chunk < 128) chunk = (str.size() < 128) ? 128 : str.size();
+      str.append_into(chunk, [&](char* out) -> ms_string::size_type {
+         in.getline(out, chunk, delimiter);
+         ms_string::size_type count = in.gcount();
+         if (in.eof()) {
+            // End of input without delimiter
+            done = true;
+            if (count || extracted) in.clear(in.rdstate() & ~std::ios_base::failbit);
+            extracted |= count;
+            return count;
+         }
+         if (in.fail()) {
+            // The buffer is full. Continue with the next chunk unless nothing could be read at all
+            if (count != chunk - 1) {
+               done = true;
+               return count;
+            }
+            in.clear(in.rdstate() & ~std::ios_base::failbit);
+            extracted = true;
+            return count;
+         }
+         // The delimiter was extracted but not stored
+         done = true;
+         return count - 1;
+      });
+   }
+   return in;
+}
+//---------------------------------------------------------------------------
+/// Read a whole file into a string using read(2). Returns false on errors
+inline bool ms_read_file(const char* path, ms_string& result) {
+   result.clear();
+   int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+   if (fd < 0) return false;
+   struct stat st;
+   bool success = ::fstat(fd, &st) == 0;
+
+   // Files like pipes do not report a size, read them in chunks until we hit the end
+   ms_string::size_type expected = (success && (st.st_size > 0)) ? (st.st_size + 1) : (1 << 16);
+   for (bool done = !success; !done;) {
+      result.append_into(expected, [&](char* out) -> ms_string::size_type {
+         ms_string::size_type written = 0;
+         while (written < expected) {
+            auto r = ::read(fd, out + written, expected - written);
+            if (r <= 0) {
+               if ((r < 0) && (errno == EINTR)) continue;
+               success = r == 0;
+               done = true;
+               break;
+            }
+            written += r;
+         }
+         return written;
+      });
+   }
+   ::close(fd);
+   return success;
+}
+//---------------------------------------------------------------------------
+namespace detail {
+/// A group of control bytes of ms_hash_map that is probed in parallel
+class hash_group {
+   public:
+   /// The number of slots per group
+   static constexpr unsigned width = 16;
+   /// Control byte of an empty slot
+   static constexpr signed char empty = -128;
+   /// Control byte of an erased slot
+   static constexpr signed char deleted = -2;
+
+   private:
+#ifdef __SSE2__
+   /// The control bytes
+   __m128i ctrl;
+
+   public:
+   /// Constructor. The position must be aligned to the group width
+   explicit hash_group(const signed char* pos) noexcept : ctrl(_mm_load_si128(reinterpret_cast<const __m128i*>(pos))) {}
+
+   /// Find all slots with the given control byte
+   unsigned match(signed char c) const noexcept { return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(c))); }
+   /// Find all full slots
+   unsigned match_full() const noexcept { return (~_mm_movemask_epi8(ctrl)) & 0xFFFF; }
+#else
+   /// The control bytes
+   const signed char* ctrl;
+
+   public:
+   /// Constructor. The position must be aligned to the group width
+   explicit hash_group(const signed char* pos) noexcept : ctrl(pos) {}
+
+   /// Find all slots with the given control byte
+   unsigned match(signed char c) const noexcept {
+      unsigned result = 0;
+      for (unsigned index = 0; index != width; ++index)
+         if (ctrl[index] == c) result |= 1u << index;
+      return result;
+   }
+   /// Find all full slots
+   unsigned match_full() const noexcept {
+      unsigned result = 0;
+      for (unsigned index = 0; index != width; ++index)
+         if (ctrl[index] >= 0) result |= 1u << index;
+      return result;
+   }
+#endif
+   /// Find all empty slots
+   unsigned match_empty() const noexcept { return match(empty); }
+   /// Find all erased slots
+   unsigned match_deleted() const noexcept { return match(deleted); }
+};
+}
+//---------------------------------------------------------------------------
+/// A hash map with open addressing that probes groups of slots in parallel. The dependencies
+/// are tracked precisely: iterators and references depend on the layout of the map and are
+/// only invalidated by a rehash, and references additionally by erasing their element.
+/// Inserting without rehash does not invalidate anything. Erased slots are reused by later
+/// inserts. Every slot has a generation that changes when its element is erased, which allows
+/// iterators to detect accesses to erased elements even if the slot has been filled again
+template <class K, class V, class Hash = std::hash<K>, class Eq = std::equal_to<K>>
+class ms_hash_map {
+   public:
+   using key_type = K;
+   using mapped_type = V;
+   using value_type = std::pair<const K, V>;
+   using size_type = unsigned long;
+   using difference_type = long;
+   using hasher = Hash;
+   using key_equal = Eq;
+   using reference = element_ref_wrapper<V>;
+   using const_reference = element_ref_wrapper<const V>;
+
+   private:
+   using group = detail::hash_group;
+   /// The type of the constructed elements. Users see the key as const, but the rehash has to move it
+   using mutable_value_type = std::pair<K, V>;
+   /// A slot. Elements are constructed with a mutable key and handed out as value_type
+   union slot_type {
+      /// The element as seen by users
+      value_type value;
+      /// The element with a mutable key
+      mutable_value_type mutableValue;
+
+      /// Constructor
+      slot_type() noexcept {}
+      /// Destructor. The elements are destroyed by the map
+      ~slot_type() {}
+   };
+   /// The generation of a slot
+   using generation_type = std::uint32_t;
+
+   /// The control bytes, one per slot, followed by the generations of the slots
+   signed char* _ctrl;
+   /// The slots
+   slot_type* _slots;
+   /// The number of slots
+   size_type _capacity;
+   /// The number of elements
+   size_type _size;
+   /// The number of slots that can still be filled before a rehash
+   size_type _growthLeft;
+   /// Have references to slots been handed out? Their slots must be released in the runtime
+   mutable bool _slotRefs;
+   /// The hash function
+   [[no_unique_address]] Hash _hash;
+   /// The comparison
+   [[no_unique_address]] Eq _eq;
+
+   static constexpr size_type npos = ~static_cast<size_type>(0);
+
+   /// Can keys be probed with other types?
+   static constexpr bool transparent = requires {
+      typename Hash::is_transparent;
+      typename Eq::is_transparent;
+   };
+
+   /// Compute the hash value. Mixes the bits, as std::hash is often the identity, unless the hash function is marked as avalanching
+   template <class Q>
+   std::size_t hash(const Q& key) const {
+      std::size_t h = _hash(key);
+      if constexpr (requires { typename Hash::is_avalanching; }) return h;
+      h ^= h >> 33;
+      h *= 0xff51afd7ed558ccdull;
+      h ^= h >> 33;
+      return h;
+   }
+   /// The usable capacity
+   static size_type max_load(size_type capacity) { return capacity - capacity / 8; }
+   /// The allocation alignment
+   static constexpr std::size_t alignment() { return alignof(slot_type) > group::width ? alignof(slot_type) : group::width; }
+   /// The offset of the slots within the allocation
+   static size_type slot_offset(size_type capacity) { return (capacity * (1 + sizeof(generation_type)) + alignof(slot_type) - 1) & ~(alignof(slot_type) - 1); }
+   /// The generations of the slots. The capacity is a multiple of the group width, so they are aligned
+   generation_type* generations() const noexcept { return reinterpret_cast<generation_type*>(_ctrl + _capacity); }
+
+   /// Find the slot of a key
+   template <class Q>
+   size_type find_slot(const Q& key) const {
+      if (!_capacity) return npos;
+      std::size_t h = hash(key), mask = _capacity / group::width - 1, pos = (h >> 7) & mask;
+      signed char h2 = h & 0x7F;
+      for (std::size_t step = 1;; ++step) {
+         group g(_ctrl + pos * group::width);
+         for (unsigned m = g.match(h2); m; m &= m - 1) {
+            size_type slot = pos * group::width + __builtin_ctz(m);
+            if (_eq(_slots[slot].value.first, key)) return slot;
+         }
+         if (g.match_empty()) return npos;
+         pos = (pos + step) & mask;
+      }
+   }
+   /// Construct an element in a slot
+   template <class... Args>
+   void construct_slot(size_type slot, Args&&... args) {
+      new (&_slots[slot].mutableValue) mutable_value_type(std::forward<Args>(args)...);
+   }
+   /// Destroy the element in a slot
+   static void destroy_slot(slot_type* slot) noexcept { slot->mutableValue.~mutable_value_type(); }
+   /// Find the slot of a key, or the slot where it should be inserted. The first erased slot on the probe sequence is
+   /// reused, otherwise the key goes to an empty slot. Returns npos for the insert position if the key goes to an empty
+   /// slot and the map is full
+   template <class Q>
+   std::pair<size_type, bool> find_or_prepare(const Q& key, std::size_t h) const {
+      if (!_capacity) return {npos, false};
+      std::size_t mask = _capacity / group::width - 1, pos = (h >> 7) & mask;
+      signed char h2 = h & 0x7F;
+      size_type erased = npos;
+      for (std::size_t step = 1;; ++step) {
+         group g(_ctrl + pos * group::width);
+         for (unsigned m = g.match(h2); m; m &= m - 1) {
+            size_type slot = pos * group::width + __builtin_ctz(m);
+            if (_eq(_slots[slot].value.first, key)) return {slot, true};
+         }
+         if ((erased == npos) && g.match_deleted()) erased = pos * group::width + __builtin_ctz(g.match_deleted());
+         if (unsigned m = g.match_empty()) {
+            if (erased != npos) return {erased, false};
+            return {_growthLeft ? pos * group::width + __builtin_ctz(m) : npos, false};
+         }
+         pos = (pos + step) & mask;
+      }
+   }
+   /// Find an empty slot for a hash value
+   size_type find_empty(std::size_t h) const {
+      std::size_t mask = _capacity / group::width - 1, pos = (h >> 7) & mask;
+      for (std::size_t step = 1;; ++step) {
+         if (unsigned m = group(_ctrl + pos * group::width).match_empty()) return pos * group::width + __builtin_ctz(m);
+         pos = (pos + step) & mask;
+      }
+   }
+   /// Release the slots of all elements in the runtime
+   void release_slots() const {
+      if (_slotRefs) {
+         for (size_type index = 0; index != _capacity; ++index)
+            if (_ctrl[index] >= 0) memorysafety::mark_destroyed(_slots + index);
+         _slotRefs = false;
+      }
+   }
+   /// Destroy all elements and release the memory
+   void destroy() {
+      release_slots();
+      if (_capacity) {
+         for (size_type index = 0; index != _capacity; ++index)
+            if (_ctrl[index] >= 0) destroy_slot(_slots + index);
+         ::operator delete(_ctrl, std::align_val_t(alignment()));
+      }
+      _ctrl = nullptr;
+      _slots = nullptr;
+      _capacity = _size = _growthLeft = 0;
+   }
+   /// Rehash into the given number of slots
+   void rehash_to(size_type capacity) {
+      memorysafety::mark_modified(this);
+      release_slots();
+
+      auto memory = static_cast<char*>(::operator new(slot_offset(capacity) + capacity * sizeof(slot_type), std::align_val_t(alignment())));
+      auto ctrl = reinterpret_cast<signed char*>(memory);
+      auto generations = reinterpret_cast<generation_type*>(memory + capacity);
+      auto slots = reinterpret_cast<slot_type*>(memory + slot_offset(capacity));
+      for (size_type index = 0; index != capacity; ++index) {
+         ctrl[index] = group::empty;
+         generations[index] = 0;
+      }
+
+      auto oldCtrl = _ctrl;
+      auto oldSlots = _slots;
+      auto oldCapacity = _capacity;
+      _ctrl = ctrl;
+      _slots = slots;
+      _capacity = capacity;
+      _growthLeft = max_load(capacity) - _size;
+
+      if (oldCapacity) {
+         for (size_type index = 0; index != oldCapacity; ++index)
+            if (oldCtrl[index] >= 0) {
+               auto& e = oldSlots[index].mutableValue;
+               std::size_t h = hash(e.first);
+               size_type slot = find_empty(h);
+               ctrl[slot] = h & 0x7F;
+               construct_slot(slot, std::move(e.first), std::move(e.second));
+               e.~mutable_value_type();
+            }
+         ::operator delete(oldCtrl, std::align_val_t(alignment()));
+      }
+   }
+   /// Make room for one more element
+   void grow() {
+      size_type capacity = _capacity ? _capacity : group::width;
+      // Grow unless dropping erased slots leaves enough room
+      while (_size >= max_load(capacity) / 4 * 3) capacity *= 2;
+      rehash_to(capacity);
+   }
+   /// Find or create the slot of a key
+   template <class KK, class... Args>
+   std::pair<size_type, bool> emplace_slot(KK&& key, Args&&... args) {
+      std::size_t h = hash(key);
+      auto [slot, found] = find_or_prepare(key, h);
+      if (found) return {slot, false};
+
+      // Reusing an erased slot does not consume room
+      if (slot == npos) {
+         grow();
+         slot = find_empty(h);
+      }
+      bool reused = _ctrl[slot] == group::deleted;
+      construct_slot(slot, std::piecewise_construct, std::forward_as_tuple(std::forward<KK>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+      _ctrl[slot] = h & 0x7F;
+      if (!reused) --_growthLeft;
+      ++_size;
+      return {slot, true};
+   }
+   /// Erase the element in a slot
+   void erase_slot(size_type slot) {
+      if (_slotRefs) memorysafety::mark_destroyed(_slots + slot);
+      destroy_slot(_slots + slot);
+      _ctrl[slot] = group::deleted;
+      ++generations()[slot];
+      --_size;
+   }
+
+   public:
+   /// An iterator
+   template <class T>
+   class basic_iterator {
+      public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = std::remove_const_t<T>;
+      using difference_type = long;
+      using pointer = T*;
+      using reference = T&;
+
+      private:
+      using slot_pointer = std::conditional_t<std::is_const_v<T>, const slot_type*, slot_type*>;
+
+      const signed char *ctrl, *limit;
+      slot_pointer slot;
+      /// The generation of the slot
+      const generation_type* generation;
+      /// The generation of the slot when the iterator moved to it
+      generation_type seen;
+
+      friend class ms_hash_map;
+
+      basic_iterator(const ms_hash_map* outer, size_type index) noexcept
+         : ctrl(outer->_ctrl + index), limit(outer->_ctrl + outer->_capacity), slot(outer->_slots + index), generation(outer->generations() + index), seen((index != outer->_capacity) ? *generation : 0) {
+         memorysafety::add_content_dependency(this, outer);
+      }
+
+      public:
+      constexpr basic_iterator() noexcept : ctrl(nullptr), limit(nullptr), slot(nullptr), generation(nullptr), seen(0) {}
+      basic_iterator(const basic_iterator& o) noexcept : ctrl(o.ctrl), limit(o.limit), slot(o.slot), generation(o.generation), seen(o.seen) { memorysafety::propagate_content(this, &o); }
+      template <class U, class = std::enable_if_t<std::is_const_v<T> && !std::is_const_v<U>>>
+      basic_iterator(const basic_iterator<U>& o) noexcept : ctrl(o.ctrl), limit(o.limit), slot(o.slot), generation(o.generation), seen(o.seen) { memorysafety::propagate_content(this, &o); }
+      ~basic_iterator() { memorysafety::mark_destroyed(this); }
+
+      basic_iterator& operator=(const basic_iterator& o) noexcept {
+         if (this != &o) {
+            memorysafety::reset(this);
+            ctrl = o.ctrl;
+            limit = o.limit;
+            slot = o.slot;
+            generation = o.generation;
+            seen = o.seen;
+            memorysafety::propagate_content(this, &o);
+         }
+         return *this;
+      }
+
+      basic_iterator& operator++() {
+         memorysafety::assert_spatial(ctrl != limit);
+         do {
+            ++ctrl;
+            ++slot;
+            ++generation;
+         } while ((ctrl != limit) && (*ctrl < 0));
+         if (ctrl != limit) seen = *generation;
+         return *this;
+      }
+      basic_iterator operator++(int) {
+         basic_iterator res = *this;
+         ++*this;
+         return res;
+      }
+      T& operator*() const {
+         // Validate first, the control bytes are gone after a rehash. A changed generation means the element was erased
+         memorysafety::validate(this);
+         memorysafety::assert_spatial((ctrl != limit) && (*ctrl >= 0) && (*generation == seen));
+         return slot->value;
+      }
+      T* operator->() const { return &**this; }
+
+      template <class U>
+      bool operator==(const basic_iterator<U>& o) const { return ctrl == o.ctrl; }
+
+      template <class U>
+      friend class basic_iterator;
+   };
+   using iterator = basic_iterator<value_type>;
+   using const_iterator = basic_iterator<const value_type>;
+
+   /// Constructor
+   constexpr ms_hash_map() noexcept : _ctrl(nullptr), _slots(nullptr), _capacity(0), _size(0), _growthLeft(0), _slotRefs(false) {}
+   /// Copy constructor
+   ms_hash_map(const ms_hash_map& o) : _ctrl(nullptr), _slots(nullptr), _capacity(0), _size(0), _growthLeft(0), _slotRefs(false), _hash(o._hash), _eq(o._eq) {
+      reserve(o._size);
+      for (size_type index = 0; index != o._capacity; ++index)
+         if (o._ctrl[index] >= 0) emplace_slot(o._slots[index].value.first, o._slots[index].value.second);
+   }
+   /// Move constructor
+   ms_hash_map(ms_hash_map&& o) noexcept
+      : _ctrl(o._ctrl), _slots(o._slots), _capacity(o._capacity), _size(o._size), _growthLeft(o._growthLeft), _slotRefs(false), _hash(o._hash), _eq(o._eq) {
+      memorysafety::mark_modified(&o);
+      o.release_slots();
+      o._ctrl = nullptr;
+      o._slots = nullptr;
+      o._capacity = o._size = o._growthLeft = 0;
+   }
+   /// Destructor
+   ~ms_hash_map() {
+      memorysafety::mark_destroyed(this);
+      destroy();
+   }
+
+   /// Assignment
+   ms_hash_map& operator=(const ms_hash_map& o) {
+      if (this != &o) {
+         ms_hash_map copy(o);
+         swap(copy);
+      }
+      return *this;
+   }
+   /// Assignment
+   ms_hash_map& operator=(ms_hash_map&& o) {
+      if (this != &o) {
+         memorysafety::mark_modified(this);
+         destroy();
+         swap(o);
+      }
+      return *this;
+   }
+
+   /// Empty?
+   bool empty() const { return !_size; }
+   /// Size
+   size_type size() const { return _size; }
+   /// The number of slots
+   size_type capacity() const { return _capacity; }
+
+   /// Make sure we have room for the given number of elements without rehashing
+   void reserve(size_type count) {
+      if (count <= _size + _growthLeft) return;
+      size_type capacity = group::width;
+      while (max_load(capacity) < count) capacity *= 2;
+      rehash_to(capacity);
+   }
+   /// Remove all elements
+   void clear() {
+      memorysafety::mark_modified(this);
+      release_slots();
+      for (size_type index = 0; index != _capacity; ++index) {
+         if (_ctrl[index] >= 0) destroy_slot(_slots + index);
+         _ctrl[index] = group::empty;
+      }
+      _size = 0;
+      _growthLeft = max_load(_capacity);
+   }
+
+   /// Iterator
+   iterator begin() {
+      size_type index = 0;
+      while ((index != _capacity) && (_ctrl[index] < 0)) ++index;
+      return iterator(this, index);
+   }
+   /// Iterator
+   const_iterator begin() const {
+      size_type index = 0;
+      while ((index != _capacity) && (_ctrl[index] < 0)) ++index;
+      return const_iterator(this, index);
+   }
+   /// Iterator
+   iterator end() { return iterator(this, _capacity); }
+   /// Iterator
+   const_iterator end() const { return const_iterator(this, _capacity); }
+
+   /// Find an element
+   iterator find(const K& key) {
+      size_type slot = find_slot(key);
+      if (slot == npos) return end();
+      return iterator(this, slot);
+   }
+   /// Find an element
+   const_iterator find(const K& key) const {
+      size_type slot = find_slot(key);
+      if (slot == npos) return end();
+      return const_iterator(this, slot);
+   }
+   /// Is the key contained in the map?
+   bool contains(const K& key) const { return find_slot(key) != npos; }
+   /// The number of elements with the key
+   size_type count(const K& key) const { return contains(key); }
+   /// Call a function with the value of a key, if it exists. The value is only available during the call, which avoids registering a reference
+   template <class F>
+   bool visit(const K& key, F&& f) {
+      size_type slot = find_slot(key);
+      if (slot == npos) return false;
+      f(_slots[slot].value.second);
+      return true;
+   }
+   /// Call a function with the value of a key, if it exists. The value is only available during the call, which avoids registering a reference
+   template <class F>
+   bool visit(const K& key, F&& f) const {
+      size_type slot = find_slot(key);
+      if (slot == npos) return false;
+      f(std::as_const(_slots[slot].value.second));
+      return true;
+   }
+   /// Access an existing element
+   reference at(const K& key) {
+      size_type slot = find_slot(key);
+      memorysafety::assert_spatial(slot != npos);
+      _slotRefs = true;
+      return reference(this, _slots + slot, _slots[slot].value.second);
+   }
+   /// Access an existing element
+   const_reference at(const K& key) const {
+      size_type slot = find_slot(key);
+      memorysafety::assert_spatial(slot != npos);
+      _slotRefs = true;
+      return const_reference(this, _slots + slot, _slots[slot].value.second);
+   }
+   /// Find an element with a key of another type. Requires transparent hash and comparison functions
+   template <class Q>
+      requires transparent
+   iterator find(const Q& key) {
+      size_type slot = find_slot(key);
+      if (slot == npos) return end();
+      return iterator(this, slot);
+   }
+   /// Find an element with a key of another type
+   template <class Q>
+      requires transparent
+   const_iterator find(const Q& key) const {
+      size_type slot = find_slot(key);
+      if (slot == npos) return end();
+      return const_iterator(this, slot);
+   }
+   /// Is the key contained in the map?
+   template <class Q>
+      requires transparent
+   bool contains(const Q& key) const { return find_slot(key) != npos; }
+   /// The number of elements with the key
+   template <class Q>
+      requires transparent
+   size_type count(const Q& key) const { return contains(key); }
+   /// Call a function with the value of a key of another type, if it exists
+   template <class Q, class F>
+      requires transparent
+   bool visit(const Q& key, F&& f) {
+      size_type slot = find_slot(key);
+      if (slot == npos) return false;
+      f(_slots[slot].value.second);
+      return true;
+   }
+   /// Call a function with the value of a key of another type, if it exists
+   template <class Q, class F>
+      requires transparent
+   bool visit(const Q& key, F&& f) const {
+      size_type slot = find_slot(key);
+      if (slot == npos) return false;
+      f(std::as_const(_slots[slot].value.second));
+      return true;
+   }
+   /// Access an existing element with a key of another type
+   template <class Q>
+      requires transparent
+   reference at(const Q& key) {
+      size_type slot = find_slot(key);
+      memorysafety::assert_spatial(slot != npos);
+      _slotRefs = true;
+      return reference(this, _slots + slot, _slots[slot].value.second);
+   }
+   /// Access an existing element with a key of another type
+   template <class Q>
+      requires transparent
+   const_reference at(const Q& key) const {
+      size_type slot = find_slot(key);
+      memorysafety::assert_spatial(slot != npos);
+      _slotRefs = true;
+      return const_reference(this, _slots + slot, _slots[slot].value.second);
+   }
+   /// Access an element, inserting a default constructed value if needed
+   reference operator[](const K& key) {
+      size_type slot = emplace_slot(key).first;
+      _slotRefs = true;
+      return reference(this, _slots + slot, _slots[slot].value.second);
+   }
+
+   /// Insert an element if the key does not exist yet
+   std::pair<iterator, bool> insert(const value_type& value) { return try_emplace(value.first, value.second); }
+   /// Insert an element if the key does not exist yet
+   std::pair<iterator, bool> insert(value_type&& value) { return try_emplace(value.first, std::move(value.second)); }
+   /// Insert an element if the key does not exist yet
+   template <class... Args>
+   std::pair<iterator, bool> try_emplace(const K& key, Args&&... args) {
+      auto [slot, inserted] = emplace_slot(key, std::forward<Args>(args)...);
+      return {iterator(this, slot), inserted};
+   }
+   /// Insert an element if the key does not exist yet
+   template <class... Args>
+   std::pair<iterator, bool> try_emplace(K&& key, Args&&... args) {
+      auto [slot, inserted] = emplace_slot(std::move(key), std::forward<Args>(args)...);
+      return {iterator(this, slot), inserted};
+   }
+   /// Insert or overwrite an element. Returns true if a new element was inserted. Does not create an iterator
+   template <class M>
+   bool insert_or_assign(const K& key, M&& value) {
+      auto [slot, inserted] = emplace_slot(key, std::forward<M>(value));
+      if (!inserted) _slots[slot].value.second = std::forward<M>(value);
+      return inserted;
+   }
+
+   /// Erase an element
+   size_type erase(const K& key) {
+      size_type slot = find_slot(key);
+      if (slot == npos) return 0;
+      erase_slot(slot);
+      return 1;
+   }
+   /// Erase an element with a key of another type
+   template <class Q>
+      requires(transparent && !std::is_convertible_v<const Q&, const_iterator>)
+   size_type erase(const Q& key) {
+      size_type slot = find_slot(key);
+      if (slot == npos) return 0;
+      erase_slot(slot);
+      return 1;
+   }
+   /// Erase an element. Returns an iterator to the next element
+   iterator erase(const_iterator iter) {
+      memorysafety::validate(&iter);
+      memorysafety::assert_spatial((iter.ctrl >= _ctrl) && (iter.ctrl < _ctrl + _capacity) && (*iter.ctrl >= 0) && (*iter.generation == iter.seen));
+      size_type slot = iter.ctrl - _ctrl;
+      erase_slot(slot);
+      while ((slot != _capacity) && (_ctrl[slot] < 0)) ++slot;
+      return iterator(this, slot);
+   }
+
+   /// Swap the content
+   void swap(ms_hash_map& o) noexcept {
+      if (this != &o) {
+         memorysafety::mark_modified(this);
+         memorysafety::mark_modified(&o);
+         release_slots();
+         o.release_slots();
+         std::swap(_ctrl, o._ctrl);
+         std::swap(_slots, o._slots);
+         std::swap(_capacity, o._capacity);
+         std::swap(_size, o._size);
+         std::swap(_growthLeft, o._growthLeft);
+         std::swap(_hash, o._hash);
+         std::swap(_eq, o._eq);
+      }
+   }
+};
+//---------------------------------------------------------------------------
+/// A segmented double ended queue. Like std::deque, inserting or removing at either end
+/// keeps references to the other elements valid, while all iterators are invalidated.
+/// Iterators therefore depend on the content of the deque, while references only depend
+/// on the existence of their element. Each segment tracks if references into it have been
+/// handed out, elements in other segments are removed without involving the runtime
+template <class T>
+class ms_deque {
+   public:
+   using value_type = T;
+   using size_type = unsigned long;
+   using difference_type = long;
+   using reference = ref_wrapper<T>;
+   using const_reference = ref_wrapper<const T>;
+
+   /// The number of elements per segment
+   static constexpr size_type segment_size = (sizeof(T) < 32) ? (512 / sizeof(T)) : 16;
+
+   private:
+   /// A segment
+   struct segment {
+      /// The elements
+      union {
+         T elements[segment_size];
+      };
+      /// Have references into the segment been handed out?
+      bool referenced = false;
+
+      /// Constructor
+      segment() noexcept {}
+      /// Destructor. The elements are destroyed by the deque
+      ~segment() {}
+   };
+
+   /// The segment map
+   segment** _map;
+   /// The size of the map
+   size_type _mapSize;
+   /// The first used entry of the map
+   size_type _firstSegment;
+   /// The number of used entries in the map
+   size_type _segments;
+   /// The position of the first element within the first segment
+   size_type _offset;
+   /// The number of elements
+   size_type _size;
+
+   /// Access an element without checks
+   T& element(size_type index) const noexcept {
+      index += _offset;
+      return _map[_firstSegment + index / segment_size]->elements[index % segment_size];
+   }
+   /// Access an element that is handed out as reference
+   T& referenced_element(size_type index) const noexcept {
+      index += _offset;
+      auto s = _map[_firstSegment + index / segment_size];
+      s->referenced = true;
+      return s->elements[index % segment_size];
+   }
+   /// Destroy an element
+   void destroy_element(size_type index) noexcept {
+      index += _offset;
+      auto s = _map[_firstSegment + index / segment_size];
+      T& e = s->elements[index % segment_size];
+      if (s->referenced) memorysafety::mark_destroyed(&e);
+      e.~T();
+   }
+   /// Make room in the map for a segment at the front or at the back
+   void grow_map(bool front) {
+      size_type needed = _segments + 1;
+      if (needed * 2 > _mapSize) {
+         size_type newSize = _mapSize ? (2 * _mapSize) : 8;
+         while (needed * 2 > newSize) newSize *= 2;
+         auto newMap = new segment*[newSize];
+         size_type newFirst = (newSize - _segments) / 2;
+         for (size_type index = 0; index != _segments; ++index) newMap[newFirst + index] = _map[_firstSegment + index];
+         delete[] _map;
+         _map = newMap;
+         _mapSize = newSize;
+         _firstSegment = newFirst;
+      } else {
+         // Re-center within the existing map
+         size_type newFirst = (_mapSize - _segments) / 2;
+         if (front && (newFirst == 0)) newFirst = 1;
+         if (newFirst < _firstSegment) {
+            for (size_type index = 0; index != _segments; ++index) _map[newFirst + index] = _map[_firstSegment + index];
+         } else {
+            for (size_type index = _segments; index != 0; --index) _map[newFirst + index - 1] = _map[_firstSegment + index - 1];
+         }
+         _firstSegment = newFirst;
+      }
+   }
+   /// Release all segments
+   void release_segments() noexcept {
+      for (size_type index = 0; index != _segments; ++index) delete _map[_firstSegment + index];
+      _segments = 0;
+      _offset = 0;
+      _firstSegment = _mapSize / 2;
+   }
+
+   public:
+   /// An iterator
+   template <class E>
+   class basic_iterator {
+      public:
+      using iterator_category = std::random_access_iterator_tag;
+      using value_type = std::remove_const_t<E>;
+      using difference_type = long;
+      using pointer = E*;
+      using reference = E&;
+
+      private:
+      const ms_deque* outer;
+      long index;
+
+      friend class ms_deque;
+
+      basic_iterator(const ms_deque* outer, long index) noexcept : outer(outer), index(index) {
+         memorysafety::add_content_dependency(this, outer);
+      }
+
+      public:
+      constexpr basic_iterator() noexcept : outer(nullptr), index(0) {}
+      basic_iterator(const basic_iterator& o) noexcept : outer(o.outer), index(o.index) { memorysafety::propagate_content(this, &o); }
+      template <class U, class = std::enable_if_t<std::is_const_v<E> && !std::is_const_v<U>>>
+      basic_iterator(const basic_iterator<U>& o) noexcept : outer(o.outer), index(o.index) { memorysafety::propagate_content(this, &o); }
+      ~basic_iterator() { memorysafety::mark_destroyed(this); }
+
+      basic_iterator& operator=(const basic_iterator& o) noexcept {
+         if (this != &o) {
+            memorysafety::reset(this);
+            outer = o.outer;
+            index = o.index;
+            memorysafety::propagate_content(this, &o);
+         }
+         return *this;
+      }
+
+      basic_iterator& operator++() { return *this += 1; }
+      basic_iterator operator++(int) {
+         basic_iterator res = *this;
+         ++*this;
+         return res;
+      }
+      basic_iterator& operator--() { return *this -= 1; }
+      basic_iterator operator--(int) {
+         basic_iterator res = *this;
+         --*this;
+         return res;
+      }
+      basic_iterator& operator+=(long step) {
+         memorysafety::validate(this);
+         memorysafety::assert_spatial(outer && (step >= -index) && (step <= static_cast<long>(outer->_size) - index));
+         index += step;
+         return *this;
+      }
+      basic_iterator& operator-=(long step) { return *this += -step; }
+      basic_iterator operator+(long step) const {
+         basic_iterator res = *this;
+         res += step;
+         return res;
+      }
+      friend basic_iterator operator+(long step, const basic_iterator& o) { return o + step; }
+      basic_iterator operator-(long step) const {
+         basic_iterator res = *this;
+         res -= step;
+         return res;
+      }
+      template <class U>
+      long operator-(const basic_iterator<U>& o) const {
+         memorysafety::assert_spatial(outer == o.outer);
+         return index - o.index;
+      }
+      E& operator*() const { return (*this)[0]; }
+      E* operator->() const { return &(*this)[0]; }
+      E& operator[](long pos) const {
+         // Validate first, the segment map might be gone otherwise
+         memorysafety::validate(this);
+         memorysafety::assert_spatial(outer && (pos >= -index) && (pos < static_cast<long>(outer->_size) - index));
+         return outer->element(index + pos);
+      }
+
+      template <class U>
+      bool operator==(const basic_iterator<U>& o) const { return index == o.index; }
+      template <class U>
+      std::strong_ordering operator<=>(const basic_iterator<U>& o) const { return index <=> o.index; }
+
+      template <class U>
+      friend class basic_iterator;
+   };
+   using iterator = basic_iterator<T>;
+   using const_iterator = basic_iterator<const T>;
+
+   /// Constructor
+   constexpr ms_deque() noexcept : _map(nullptr), _mapSize(0), _firstSegment(0), _segments(0), _offset(0), _size(0) {}
+   /// Copy constructor
+   ms_deque(const ms_deque& o) : ms_deque() {
+      for (size_type index = 0; index != o._size; ++index) push_back(o.element(index));
+   }
+   /// Move constructor. References stay valid, as the elements themselves do not move
+   ms_deque(ms_deque&& o) noexcept : _map(o._map), _mapSize(o._mapSize), _firstSegment(o._firstSegment), _segments(o._segments), _offset(o._offset), _size(o._size) {
+      memorysafety::mark_modified(&o);
+      o._map = nullptr;
+      o._mapSize = o._firstSegment = o._segments = o._offset = o._size = 0;
+   }
+   /// Destructor
+   ~ms_deque() {
+      memorysafety::mark_destroyed(this);
+      clear();
+      delete[] _map;
+   }
+
+   /// Assignment
+   ms_deque& operator=(const ms_deque& o) {
+      if (this != &o) {
+         ms_deque copy(o);
+         swap(copy);
+      }
+      return *this;
+   }
+   /// Assignment
+   ms_deque& operator=(ms_deque&& o) noexcept {
+      if (this != &o) {
+         clear();
+         swap(o);
+      }
+      return *this;
+   }
+
+   /// Empty?
+   bool empty() const { return !_size; }
+   /// Size
+   size_type size() const { return _size; }
+
+   /// Access
+   reference operator[](size_type pos) {
+      memorysafety::assert_spatial(pos < _size);
+      return reference(referenced_element(pos));
+   }
+   /// Access
+   const_reference operator[](size_type pos) const {
+      memorysafety::assert_spatial(pos < _size);
+      return const_reference(std::as_const(referenced_element(pos)));
+   }
+   /// Access
+   reference front() { return (*this)[0]; }
+   /// Access
+   const_reference front() const { return (*this)[0]; }
+   /// Access
+   reference back() { return (*this)[_size - 1]; }
+   /// Access
+   const_reference back() const { return (*this)[_size - 1]; }
+
+   /// Iterator
+   iterator begin() { return iterator(this, 0); }
+   /// Iterator
+   const_iterator begin() const { return const_iterator(this, 0); }
+   /// Iterator
+   iterator end() { return iterator(this, _size); }
+   /// Iterator
+   const_iterator end() const { return const_iterator(this, _size); }
+
+   /// Append an element
+   template <class... Args>
+   void emplace_back(Args&&... args) {
+      memorysafety::mark_modified(this);
+      size_type pos = _offset + _size;
+      if (pos == _segments * segment_size) {
+         if (_firstSegment + _segments == _mapSize) grow_map(false);
+         _map[_firstSegment + _segments] = new segment();
+         ++_segments;
+      }
+      new (&_map[_firstSegment + pos / segment_size]->elements[pos % segment_size]) T(std::forward<Args>(args)...);
+      ++_size;
+   }
+   /// Prepend an element
+   template <class... Args>
+   void emplace_front(Args&&... args) {
+      memorysafety::mark_modified(this);
+      if (!_offset) {
+         if (!_firstSegment) grow_map(true);
+         _map[--_firstSegment] = new segment();
+         ++_segments;
+         _offset = segment_size;
+      }
+      new (&_map[_firstSegment]->elements[_offset - 1]) T(std::forward<Args>(args)...);
+      --_offset;
+      ++_size;
+   }
+   /// Append an element
+   void push_back(const T& value) { emplace_back(value); }
+   /// Append an element
+   void push_back(T&& value) { emplace_back(std::move(value)); }
+   /// Prepend an element
+   void push_front(const T& value) { emplace_front(value); }
+   /// Prepend an element
+   void push_front(T&& value) { emplace_front(std::move(value)); }
+   /// Remove the last element
+   void pop_back() {
+      memorysafety::assert_spatial(_size > 0);
+      memorysafety::mark_modified(this);
+      destroy_element(_size - 1);
+      --_size;
+      if (!_size) {
+         release_segments();
+      } else if (_offset + _size <= (_segments - 1) * segment_size) {
+         delete _map[_firstSegment + --_segments];
+      }
+   }
+   /// Remove the first element
+   void pop_front() {
+      memorysafety::assert_spatial(_size > 0);
+      memorysafety::mark_modified(this);
+      destroy_element(0);
+      ++_offset;
+      --_size;
+      if (!_size) {
+         release_segments();
+      } else if (_offset == segment_size) {
+         delete _map[_firstSegment++];
+         --_segments;
+         _offset = 0;
+      }
+   }
+   /// Remove all elements
+   void clear() {
+      memorysafety::mark_modified(this);
+      for (size_type index = 0; index != _size; ++index) destroy_element(index);
+      _size = 0;
+      release_segments();
+   }
+
+   /// Swap the content. References stay valid, as the elements themselves do not move
+   void swap(ms_deque& o) noexcept {
+      if (this != &o) {
+         memorysafety::mark_modified(this);
+         memorysafety::mark_modified(&o);
+         std::swap(_map, o._map);
+         std::swap(_mapSize, o._mapSize);
+         std::swap(_firstSegment, o._firstSegment);
+         std::swap(_segments, o._segments);
+         std::swap(_offset, o._offset);
+         std::swap(_size, o._size);
+      }
+   }
+};
+//---------------------------------------------------------------------------
+/// A compile time index for ms_array, e.g., a[ms_index<2>]
+template <std::size_t I>
+inline constexpr std::integral_constant<std::size_t, I> ms_index{};
+//---------------------------------------------------------------------------
+namespace detail {
+#if defined(__GNUC__) && !defined(__clang__)
+/// Reached if the optimizer proves that a constant index is out of bounds. Defined and never inlined, so the program
+/// always links and the compiler warns at every call that survives optimization
+[[gnu::warning("ms_array index is out of bounds"), gnu::noinline]] inline void ms_array_out_of_bounds() noexcept { memorysafety::assert_spatial_failed(); }
+#endif
+}
+//---------------------------------------------------------------------------
+/// A fixed size array. The storage never moves, so iterators and short-term references need
+/// no tracking and only bounds checks, which vanish for constant indices and static loops.
+/// Compile time indices are checked at compile time, constant indices that the optimizer
+/// proves to be out of bounds cause a compiler warning. The array is trivially copyable if T
+/// is and does not report to the runtime, references that escape are handed out by an
+/// ms_array_escapes handle, which registers their dependencies
+template <class T, std::size_t N>
+struct ms_array {
+   using value_type = T;
+   using size_type = std::size_t;
+   using difference_type = long;
+
+   /// A bounds checked iterator
+   template <class E>
+   class basic_iterator {
+      public:
+      using iterator_category = std::random_access_iterator_tag;
+      using iterator_concept = std::contiguous_iterator_tag;
+      using value_type = std::remove_const_t<E>;
+      using difference_type = long;
+      using pointer = E*;
+      using reference = E&;
+
+      private:
+      E *start, *iter;
+
+      friend struct ms_array;
+
+      constexpr basic_iterator(E* start, E* iter) noexcept : start(start), iter(iter) {}
+
+      public:
+      constexpr basic_iterator() noexcept : start(nullptr), iter(nullptr) {}
+      template <class U, class = std::enable_if_t<std::is_const_v<E> && !std::is_const_v<U>>>
+      constexpr basic_iterator(const basic_iterator<U>& o) noexcept : start(o.start), iter(o.iter) {}
+
+      constexpr basic_iterator& operator++() { return *this += 1; }
+      constexpr basic_iterator operator++(int) {
+         basic_iterator res = *this;
+         ++*this;
+         return res;
+      }
+      constexpr basic_iterator& operator--() { return *this -= 1; }
+      constexpr basic_iterator operator--(int) {
+         basic_iterator res = *this;
+         --*this;
+         return res;
+      }
+      constexpr basic_iterator& operator+=(long step) {
+         if ((step < (start - iter)) || (step > (start + static_cast<long>(N) - iter))) memorysafety::assert_spatial_failed();
+         iter += step;
+         return *this;
+      }
+      constexpr basic_iterator& operator-=(long step) { return *this += -step; }
+      constexpr basic_iterator operator+(long step) const {
+         basic_iterator res = *this;
+         res += step;
+         return res;
+      }
+      friend constexpr basic_iterator operator+(long step, const basic_iterator& o) { return o + step; }
+      constexpr basic_iterator operator-(long step) const {
+         basic_iterator res = *this;
+         res -= step;
+         return res;
+      }
+      constexpr long operator-(const basic_iterator& o) const {
+         if (start != o.start) memorysafety::assert_spatial_failed();
+         return iter - o.iter;
+      }
+      constexpr E& operator*() const { return (*this)[0]; }
+      constexpr E& operator[](long pos) const {
+         if ((pos < (start - iter)) || (pos >= (start + static_cast<long>(N) - iter))) memorysafety::assert_spatial_failed();
+         return iter[pos];
+      }
+      /// Raw pointer access, used by std::to_address. Not bounds checked, as the end position is a valid result
+      constexpr E* operator->() const { return iter; }
+
+      constexpr bool operator==(const basic_iterator& o) const { return iter == o.iter; }
+      constexpr std::strong_ordering operator<=>(const basic_iterator& o) const { return iter <=> o.iter; }
+
+      template <class U>
+      friend class basic_iterator;
+   };
+   using iterator = basic_iterator<T>;
+   using const_iterator = basic_iterator<const T>;
+
+   /// The elements. Public to allow for aggregate initialization
+   T _elements[N ? N : 1];
+
+   /// Size
+   static constexpr size_type size() noexcept { return N; }
+   /// Empty?
+   static constexpr bool empty() noexcept { return !N; }
+
+   /// Access. The result must not outlive the array
+   constexpr T& operator[](size_type pos) noexcept {
+      check(pos);
+      return _elements[pos];
+   }
+   /// Access. The result must not outlive the array
+   constexpr const T& operator[](size_type pos) const noexcept {
+      check(pos);
+      return _elements[pos];
+   }
+   /// Access with a compile time index
+   template <size_type I>
+   constexpr T& operator[](std::integral_constant<size_type, I>) noexcept {
+      static_assert(I < N, "ms_array index is out of bounds");
+      return _elements[I];
+   }
+   /// Access with a compile time index
+   template <size_type I>
+   constexpr const T& operator[](std::integral_constant<size_type, I>) const noexcept {
+      static_assert(I < N, "ms_array index is out of bounds");
+      return _elements[I];
+   }
+   /// Access with a compile time index
+   template <size_type I>
+   constexpr T& get() noexcept { return (*this)[ms_index<I>]; }
+   /// Access with a compile time index
+   template <size_type I>
+   constexpr const T& get() const noexcept { return (*this)[ms_index<I>]; }
+   /// Access
+   constexpr T& front() noexcept { return (*this)[0]; }
+   /// Access
+   constexpr const T& front() const noexcept { return (*this)[0]; }
+   /// Access
+   constexpr T& back() noexcept { return (*this)[N - 1]; }
+   /// Access
+   constexpr const T& back() const noexcept { return (*this)[N - 1]; }
+
+   /// Iterator
+   constexpr iterator begin() noexcept { return iterator(_elements, _elements); }
+   /// Iterator
+   constexpr const_iterator begin() const noexcept { return const_iterator(_elements, _elements); }
+   /// Iterator
+   constexpr iterator end() noexcept { return iterator(_elements, _elements + N); }
+   /// Iterator
+   constexpr const_iterator end() const noexcept { return const_iterator(_elements, _elements + N); }
+
+   /// Apply a function to all elements. The bounds are static, so no checks are needed
+   template <class F>
+   constexpr void for_each(F&& f) {
+      for (size_type index = 0; index != N; ++index) f(_elements[index]);
+   }
+   /// Apply a function to all elements. The bounds are static, so no checks are needed
+   template <class F>
+   constexpr void for_each(F&& f) const {
+      for (size_type index = 0; index != N; ++index) f(_elements[index]);
+   }
+   /// Assign a value to all elements
+   constexpr void fill(const T& value) {
+      for (size_type index = 0; index != N; ++index) _elements[index] = value;
+   }
+
+   private:
+   /// Check an index. An out of bounds index in a constant expression fails compilation, as the failure handler is not
+   /// constexpr
+   static constexpr void check(size_type pos) noexcept {
+#if defined(__GNUC__) && !defined(__clang__)
+      if (__builtin_constant_p(pos >= N) && (pos >= N)) detail::ms_array_out_of_bounds();
+#endif
+      if (pos >= N) memorysafety::assert_spatial_failed();
+   }
+};
+//---------------------------------------------------------------------------
+/// Hands out references into an ms_array that may escape the current scope. The references
+/// depend on the handle, which keeps the array itself trivially copyable. Declare the handle
+/// right after the array, so that it is destroyed first, e.g., ms_array_escapes escapes(a)
+template <class A>
+class ms_array_escapes {
+   public:
+   using size_type = std::size_t;
+   using escaping_reference = inner_ref_wrapper<std::remove_reference_t<decltype(std::declval<A&>()[0])>>;
+
+   private:
+   /// The array
+   A* _array;
+   /// Have references been handed out?
+   bool _escaped = false;
+
+   public:
+   /// Constructor
+   explicit ms_array_escapes(A& array) noexcept : _array(std::addressof(array)) {}
+   /// Destructor. Invalidates all references
+   ~ms_array_escapes() {
+      if (_escaped) memorysafety::mark_destroyed(this);
+   }
+
+   ms_array_escapes(const ms_array_escapes&) = delete;
+   ms_array_escapes& operator=(const ms_array_escapes&) = delete;
+
+   /// A reference that may escape. Becomes invalid when the handle is destroyed
+   escaping_reference ref(size_type pos) noexcept {
+      auto& element = (*_array)[pos];
+      _escaped = true;
+      return escaping_reference(this, element);
+   }
+};
+//---------------------------------------------------------------------------
+class ms_arena;
+//---------------------------------------------------------------------------
+/// A reference to an object allocated from an ms_arena. The reference depends on the current
+/// generation of the arena and becomes invalid when the arena is reset or destroyed
+template <class T>
+class arena_ref {
+   public:
+   // types
+   typedef T type;
+
+   private:
+   T* _ptr;
+   const ms_arena* _arena;
+
+   friend class ms_arena;
+
+   arena_ref(const ms_arena* arena, T& object) noexcept : _ptr(std::addressof(object)), _arena(arena) {
+      // The reference depends on the current generation of the arena
+      memorysafety::add_generation_dependency(this, arena);
+   }
+
+   public:
+   // construct/copy/destroy
+   arena_ref(const arena_ref& o) noexcept
+      : _ptr(o._ptr), _arena(o._arena) {
+      // Propagate invalid states first, otherwise we would pick up the current generation
+      memorysafety::propagate_invalid(this, &o);
+      memorysafety::add_generation_dependency(this, _arena);
+   }
+   ~arena_ref() {
+      // The reference was destroyed
+      memorysafety::mark_destroyed(this);
+   }
+
+   // assignment
+   arena_ref& operator=(const arena_ref& o) noexcept {
+      if (this != &o) {
+         // Clear all existing dependencies make valid again
+         memorysafety::reset(this);
+
+         // Copy the dependency from the other reference and propagate invalid states
+         _ptr = o._ptr;
+         _arena = o._arena;
+         memorysafety::propagate_invalid(this, &o);
+         memorysafety::add_generation_dependency(this, _arena);
+      }
+      return *this;
+   }
+
+   // access
+   operator T&() const noexcept {
+      memorysafety::validate(this);
+      return *_ptr;
+   }
+   T& get() const noexcept {
+      memorysafety::validate(this);
+      return *_ptr;
+   }
+   T* operator->() const noexcept {
+      memorysafety::validate(this);
+      return _ptr;
+   }
+};
+//---------------------------------------------------------------------------
+/// A bump allocator. All references to objects allocated from the arena depend on the current
+/// generation of the arena, reset() starts a new generation and thus invalidates all of them
+/// at once without visiting them. Destructors are only run for objects that need them
+class ms_arena {
+   /// A chunk of memory
+   struct alignas(std::max_align_t) chunk {
+      /// The next chunk
+      chunk* next;
+      /// The usable size
+      std::size_t size;
+
+      /// The memory
+      char* begin() { return reinterpret_cast<char*>(this + 1); }
+      /// The end of the memory
+      char* end() { return begin() + size; }
+   };
+   /// A registered destructor call
+   struct finalizer {
+      /// The next finalizer
+      finalizer* next;
+      /// The destructor call
+      void (*destroy)(void*);
+      /// The object
+      void* object;
+   };
+
+   /// All chunks
+   chunk* _chunks;
+   /// The current chunk
+   chunk* _current;
+   /// The current position
+   char *_pos, *_end;
+   /// The registered destructor calls
+   finalizer* _finalizers;
+   /// The default chunk size
+   std::size_t _chunkSize;
+
+   /// Move to a chunk that can hold the requested size
+   void next_chunk(std::size_t size, std::size_t align) {
+      std::size_t needed = size + align;
+      while (_current && _current->next) {
+         _current = _current->next;
+         if (_current->size >= needed) {
+            _pos = _current->begin();
+            _end = _current->end();
+            return;
+         }
+      }
+
+      // Allocate a new chunk
+      std::size_t chunkSize = (needed > _chunkSize) ? needed : _chunkSize;
+      auto c = static_cast<chunk*>(::operator new(sizeof(chunk) + chunkSize));
+      c->size = chunkSize;
+      if (_current) {
+         c->next = _current->next;
+         _current->next = c;
+      } else {
+         c->next = nullptr;
+         _chunks = c;
+      }
+      _current = c;
+      _pos = c->begin();
+      _end = c->end();
+   }
+
+   public:
+   /// Constructor
+   explicit ms_arena(std::size_t chunkSize = 64 * 1024) noexcept : _chunks(nullptr), _current(nullptr), _pos(nullptr), _end(nullptr), _finalizers(nullptr), _chunkSize(chunkSize) {}
+   /// Destructor
+   ~ms_arena() {
+      reset();
+      memorysafety::mark_destroyed(this);
+      while (_chunks) {
+         auto next = _chunks->next;
+         ::operator delete(_chunks);
+         _chunks = next;
+      }
+   }
+
+   ms_arena(const ms_arena&) = delete;
+   ms_arena& operator=(const ms_arena&) = delete;
+
+   /// Allocate raw memory. The memory is reused after reset()
+   void* allocate(std::size_t size, std::size_t align = alignof(std::max_align_t)) {
+      memorysafety::assert_spatial(align && !(align & (align - 1)));
+      auto aligned = [&]() { return reinterpret_cast<char*>((reinterpret_cast<std::uintptr_t>(_pos) + align - 1) & ~(align - 1)); };
+      char* result = _pos ? aligned() : nullptr;
+      if ((!result) || (result > _end) || (static_cast<std::size_t>(_end - result) < size)) {
+         next_chunk(size, align);
+         result = aligned();
+      }
+      _pos = result + size;
+      return result;
+   }
+   /// Create an object in the arena
+   template <class T, class... Args>
+   arena_ref<T> make(Args&&... args) {
+      T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+      if constexpr (!std::is_trivially_destructible_v<T>) {
+         auto f = static_cast<finalizer*>(allocate(sizeof(finalizer), alignof(finalizer)));
+         f->next = _finalizers;
+         f->destroy = [](void* o) { static_cast<T*>(o)->~T(); };
+         f->object = object;
+         _finalizers = f;
+      }
+      return arena_ref<T>(this, *object);
+   }
+   /// Release all objects and invalidate all references into the arena. The memory is kept for reuse
+   void reset() noexcept {
+      for (auto f = _finalizers; f; f = f->next) f->destroy(f->object);
+      _finalizers = nullptr;
+      memorysafety::next_generation(this);
+      _current = _chunks;
+      _pos = _chunks ? _chunks->begin() : nullptr;
+      _end = _chunks ? _chunks->end() : nullptr;
+   }
+};
+//---------------------------------------------------------------------------
+/// A string builder for append-heavy workloads. The characters are stored in chunks that
+/// never move, appending never relocates earlier fragments, and views of appended fragments
+/// stay valid until the builder is cleared or destroyed. str() produces an ms_string with a
+/// single allocation
+class ms_string_builder {
+   public:
+   using size_type = unsigned long;
+
+   private:
+   /// A chunk of characters
+   struct chunk {
+      /// The next chunk
+      chunk* next;
+      /// The capacity
+      size_type capacity;
+      /// The used space
+      size_type used;
+
+      /// The characters
+      char* data() { return reinterpret_cast<char*>(this + 1); }
+   };
+
+   /// The chunks
+   chunk *_first, *_last;
+   /// The total size
+   size_type _size;
+   /// The capacity of the next chunk
+   size_type _nextCapacity;
+   /// Have views been handed out? Then the chunks must be released in the runtime
+   bool _viewed;
+
+   /// Reserve space for a fragment. Fragments never span chunks
+   char* reserve_fragment(size_type len) {
+      if ((!_last) || ((_last->capacity - _last->used) < len)) {
+         size_type capacity = (len > _nextCapacity) ? len : _nextCapacity;
+         if (_nextCapacity < (1 << 20)) _nextCapacity *= 2;
+         auto c = static_cast<chunk*>(::operator new(sizeof(chunk) + capacity));
+         c->next = nullptr;
+         c->capacity = capacity;
+         c->used = 0;
+         if (_last)
+            _last->next = c;
+         else
+            _first = c;
+         _last = c;
+      }
+      char* result = _last->data() + _last->used;
+      _last->used += len;
+      _size += len;
+      return result;
+   }
+   /// Append a fragment
+   char* append_fragment(const char* data, size_type len) {
+      char* result = reserve_fragment(len);
+      if (len) std::memcpy(result, data, len);
+      return result;
+   }
+
+   public:
+   /// Constructor
+   ms_string_builder() noexcept : _first(nullptr), _last(nullptr), _size(0), _nextCapacity(256), _viewed(false) {}
+   /// Destructor
+   ~ms_string_builder() { clear(); }
+
+   ms_string_builder(const ms_string_builder&) = delete;
+   ms_string_builder& operator=(const ms_string_builder&) = delete;
+
+   /// Empty?
+   bool empty() const { return !_size; }
+   /// Size
+   size_type size() const { return _size; }
+
+   /// Append characters
+   ms_string_builder& append(const char* data, size_type len) {
+      append_fragment(data, len);
+      return *this;
+   }
+   /// Append a C string
+   ms_string_builder& append(const char* cstr) { return append(cstr, std::strlen(cstr)); }
+   /// Append a character
+   ms_string_builder& append(char c) {
+      *reserve_fragment(1) = c;
+      return *this;
+   }
+   /// Append a string
+   ms_string_builder& append(const ms_string& s);
+   /// Append a view
+   ms_string_builder& append(const ms_string_view& v) {
+      auto s = v.span();
+      return append(s.data(), s.size());
+   }
+   /// Append a number using std::to_chars
+   template <class T>
+      requires(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>)
+   ms_string_builder& append_number(T value) {
+      char buffer[detail::max_chars<T>()];
+      return append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr - buffer);
+   }
+   /// Append a character
+   ms_string_builder& operator<<(char c) { return append(c); }
+   /// Append a number
+   template <class T>
+      requires(std::is_arithmetic_v<T> && !std::is_same_v<T, bool> && !std::is_same_v<T, char>)
+   ms_string_builder& operator<<(T value) { return append_number(value); }
+   /// Append a string
+   template <class T>
+      requires(std::is_convertible_v<const T&, const char*> || std::is_same_v<T, ms_string> || std::is_same_v<T, ms_string_view>)
+   ms_string_builder& operator<<(const T& value) { return append(value); }
+
+   /// Append characters and return a view of them. The view stays valid until the builder is cleared
+   ms_string_view append_view(const char* data, size_type len) {
+      char* fragment = append_fragment(data, len);
+      _viewed = true;
+      return ms_string_view(_last, false, fragment, len);
+   }
+   /// Append a string and return a view of the appended characters
+   ms_string_view append_view(const ms_string& s);
+   /// Append a view and return a view of the appended characters
+   ms_string_view append_view(const ms_string_view& v) {
+      auto s = v.span();
+      return append_view(s.data(), s.size());
+   }
+
+   /// Remove all characters. Invalidates all views
+   void clear() {
+      while (_first) {
+         auto next = _first->next;
+         if (_viewed) memorysafety::mark_destroyed(_first);
+         ::operator delete(_first);
+         _first = next;
+      }
+      _last = nullptr;
+      _size = 0;
+      _viewed = false;
+   }
+   /// Build the string, using a single allocation
+   ms_string str() const;
+};
+//---------------------------------------------------------------------------
+inline ms_string_builder& ms_string_builder::append(const ms_string& s) { return append(s.view()); }
+//---------------------------------------------------------------------------
+inline ms_string_view ms_string_builder::append_view(const ms_string& s) { return append_view(s.view()); }
+//---------------------------------------------------------------------------
+inline ms_string ms_string_builder::str() const {
+   ms_string result;
+   result.append_into(_size, [&](char* out) {
+      for (auto c = _first; c; c = c->next) {
+         if (c->used) std::memcpy(out, c->data(), c->used);
+         out += c->used;
+      }
+      return _size;
+   });
+   return result;
+}
+//---------------------------------------------------------------------------
+/// A read-only memory mapped file. Views into the mapping depend on the existence of the
+/// mapping, unmapping or remapping the file invalidates them. Reading requires no copies
+class ms_mapped_file {
+   public:
+   using size_type = unsigned long;
+
+   private:
+   /// The mapped data
+   const char* _data;
+   /// The size
+   size_type _size;
+   /// Is a file mapped?
+   bool _mapped;
+
+   public:
+   /// Constructor
+   ms_mapped_file() noexcept : _data(nullptr), _size(0), _mapped(false) {}
+   /// Constructor
+   explicit ms_mapped_file(const char* path) : ms_mapped_file() { map(path); }
+   /// Destructor
+   ~ms_mapped_file() { unmap(); }
+
+   ms_mapped_file(const ms_mapped_file&) = delete;
+   ms_mapped_file& operator=(const ms_mapped_file&) = delete;
+
+   /// Map a file. Invalidates all views of a previous mapping
+   bool map(const char* path) {
+      unmap();
+      int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+      if (fd < 0) return false;
+      struct stat st;
+      if (::fstat(fd, &st) < 0) {
+         ::close(fd);
+         return false;
+      }
+      size_type size = st.st_size;
+      if (size) {
+         void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+         if (data == MAP_FAILED) {
+            ::close(fd);
+            return false;
+         }
+         ::madvise(data, size, MADV_SEQUENTIAL);
+         _data = static_cast<const char*>(data);
+      }
+      ::close(fd);
+      _size = size;
+      _mapped = true;
+      return true;
+   }
+   /// Unmap the file. Invalidates all views, including empty views that were taken while no file was mapped
+   void unmap() {
+      memorysafety::mark_destroyed(this);
+      if (!_mapped) return;
+      if (_size) ::munmap(const_cast<char*>(_data), _size);
+      _data = nullptr;
+      _size = 0;
+      _mapped = false;
+   }
+
+   /// Is a file mapped?
+   bool is_mapped() const { return _mapped; }
+   /// Empty?
+   bool empty() const { return !_size; }
+   /// Size
+   size_type size() const { return _size; }
+
+   /// A view of the mapped data
+   ms_string_view view(size_type pos = 0, size_type count = ms_string_view::npos) const {
+      memorysafety::assert_spatial(pos <= _size);
+      return ms_string_view(this, false, _data + pos, ((_size - pos) < count) ? (_size - pos) : count);
+   }
+};
+//---------------------------------------------------------------------------
+namespace detail {
+//---------------------------------------------------------------------------
+/// Find all occurrences of a delimiter in [begin, end). Calls f(pos) for each occurrence until f returns false, returns the position where the search stopped
+template <class F>
+const char* find_delimiters(const char* begin, const char* end, char delimiter, F&& f) {
+   const char* iter = begin;
+#ifdef __SSE2__
+   __m128i pattern = _mm_set1_epi8(delimiter);
+   for (; end - iter >= 16; iter += 16) {
+      unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(iter)), pattern));
+      while (mask) {
+         const char* pos = iter + __builtin_ctz(mask);
+         mask &= mask - 1;
+         if (!f(pos)) return pos + 1;
+      }
+   }
+#endif
+   for (; iter != end; ++iter)
+      if ((*iter == delimiter) && (!f(iter))) return iter + 1;
+   return end;
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+/// A batch of tokens produced by ms_tokenizer. The batch holds a single dependency on the
+/// source for all its tokens, which are accessed without any further registration
+class ms_token_batch {
+   public:
+   using size_type = unsigned long;
+
+   /// The maximum number of tokens per batch
+   static constexpr unsigned capacity = 64;
+
+   private:
+   /// The source. Carries the dependencies of the batch
+   ms_string_view _source;
+   /// The token boundaries as offsets into the source
+   size_type _begin[capacity], _end[capacity];
+   /// The number of tokens
+   unsigned _count = 0;
+
+   friend class ms_tokenizer;
+
+   public:
+   /// Empty?
+   bool empty() const { return !_count; }
+   /// The number of tokens
+   unsigned size() const { return _count; }
+
+   /// Access a token. The result must not outlive the batch
+   std::span<const char> operator[](unsigned index) const {
+      memorysafety::assert_spatial(index < _count);
+      return _source.span().subspan(_begin[index], _end[index] - _begin[index]);
+   }
+   /// A checked view of a token that can outlive the batch
+   ms_string_view view(unsigned index) const {
+      memorysafety::assert_spatial(index < _count);
+      return _source.substr(_begin[index], _end[index] - _begin[index]);
+   }
+};
+//---------------------------------------------------------------------------
+/// A zero-copy tokenizer that splits a view (e.g., of an ms_string or of an ms_mapped_file)
+/// at a delimiter. A trailing delimiter does not produce an empty token, which gives the
+/// usual line semantics when splitting at '\n'
+class ms_tokenizer {
+   public:
+   using size_type = unsigned long;
+
+   private:
+   /// The source
+   ms_string_view _source;
+   /// The current position
+   size_type _pos;
+   /// The delimiter
+   char _delimiter;
+
+   public:
+   /// Constructor
+   ms_tokenizer(const ms_string_view& source, char delimiter) : _source(source), _pos(0), _delimiter(delimiter) {}
+
+   /// Produce the next batch of tokens. Returns false if the input is exhausted
+   bool next(ms_token_batch& batch) {
+      batch._count = 0;
+      auto data = _source.span();
+      if (_pos >= data.size()) return false;
+
+      // A single dependency for the whole batch
+      batch._source = _source;
+
+      const char *begin = data.data(), *end = begin + data.size();
+      size_type start = _pos;
+      auto stop = detail::find_delimiters(begin + _pos, end, _delimiter, [&](const char* pos) {
+         batch._begin[batch._count] = start;
+         batch._end[batch._count] = pos - begin;
+         start = (pos - begin) + 1;
+         return ++batch._count < ms_token_batch::capacity;
+      });
+      if ((stop == end) && (start < data.size()) && (batch._count < ms_token_batch::capacity)) {
+         batch._begin[batch._count] = start;
+         batch._end[batch._count] = data.size();
+         ++batch._count;
+         start = data.size();
+      }
+      _pos = start;
+      return true;
    }
-   /// Access
-   reference front() {
-      memorysafety::assert_spatial(_size > 0);
-      return reference(this, _ptr[0]);
+};
+//---------------------------------------------------------------------------
+/// A mutex that spins briefly before parking the thread. Short critical sections under
+/// moderate contention avoid the syscalls of a parking mutex, while long waits do not burn
+/// CPU time
+class adaptive_mutex {
+   /// The state. 0 = unlocked, 1 = locked, 2 = locked with (potential) waiters
+   std::atomic<unsigned> _state{0};
+
+   /// The number of spins before parking
+   static constexpr unsigned spinCount = 128;
+
+   public:
+   /// Lock
+   void lock() noexcept {
+      unsigned expected = 0;
+      if (_state.compare_exchange_strong(expected, 1, std::memory_order_acquire)) return;
+
+      // Spin for a while
+      for (unsigned spin = 0; spin != spinCount; ++spin) {
+#ifdef __SSE2__
+         _mm_pause();
+#endif
+         expected = 0;
+         if ((_state.load(std::memory_order_relaxed) == 0) && _state.compare_exchange_weak(expected, 1, std::memory_order_acquire)) return;
+      }
+
+      // Park until the lock is released
+      while (_state.exchange(2, std::memory_order_acquire) != 0) _state.wait(2, std::memory_order_relaxed);
    }
-   /// Access
-   const_reference front() const {
-      memorysafety::assert_spatial(_size > 0);
-      return const_reference(this, _ptr[0]);
+   /// Try to lock
+   bool try_lock() noexcept {
+      unsigned expected = 0;
+      return _state.compare_exchange_strong(expected, 1, std::memory_order_acquire);
    }
-   /// Access
-   reference back() {
-      memorysafety::assert_spatial(_size > 0);
-      return reference(this, _ptr[_size - 1]);
+   /// Unlock
+   void unlock() noexcept {
+      if (_state.exchange(0, std::memory_order_release) == 2) _state.notify_one();
    }
-   /// Access
-   const_reference back() const {
-      memorysafety::assert_spatial(_size > 0);
-      return const_reference(this, _ptr[_size - 1]);
+};
+//---------------------------------------------------------------------------
+namespace detail {
+//---------------------------------------------------------------------------
+/// Share an object with all threads. Uses the share method of the object if it has one, which also updates its owner tag
+template <class T>
+void share_object(T& value) {
+   if constexpr (requires { value.share(); })
+      value.share();
+   else
+      memorysafety::share(&value);
+}
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+/// An object that is protected by a mutex and can only be accessed within apply. The value
+/// lives in the shared runtime domain, and all objects that depend on it are invalidated when
+/// apply returns, which catches checked references and iterators that escaped the callback.
+/// Objects nested in the value that are referenced directly must be shared explicitly
+template <class T, class Mutex = std::mutex>
+class locked {
+   /// The mutex
+   Mutex _mutex;
+   /// The value
+   T _value;
+
+   public:
+   /// Constructor
+   template <class... Args>
+   explicit locked(Args&&... args) : _value(std::forward<Args>(args)...) { detail::share_object(_value); }
+   /// Destructor
+   ~locked() { memorysafety::mark_destroyed(&_value); }
+
+   locked(const locked&) = delete;
+   locked& operator=(const locked&) = delete;
+
+   /// Call f with exclusive access to the value
+   template <class F>
+   decltype(auto) apply(F&& f) {
+      std::lock_guard guard(_mutex);
+      struct Release {
+         T* value;
+         ~Release() { memorysafety::invalidate_dependents(value); }
+      } release{&_value};
+      return std::forward<F>(f)(_value);
    }
-   /// Access the raw data. TODO result is currently unsafe, we need a checking wrapper here
-   const char* data() const { return _ptr; }
+};
+//---------------------------------------------------------------------------
+/// An object with an adaptive spin-then-park lock
+template <class T>
+using adaptive_locked = locked<T, adaptive_mutex>;
+//---------------------------------------------------------------------------
+/// An object that is protected by a reader/writer lock. Readers get shared const access, writers
+/// exclusive access. As readers can run concurrently, references that escape a reader are
+/// invalidated by the next writer, before the writer modifies the value
+template <class T>
+class rw_locked {
+   /// The mutex
+   mutable std::shared_mutex _mutex;
+   /// The value
+   T _value;
 
-   /// Iterator
-   iterator begin() { return iterator(this, _ptr, _ptr + _size); }
-   /// Iterator
-   const_iterator begin() const { return const_iterator(this, _ptr, _ptr + _size); }
-   /// Iterator
-   const_iterator cbegin() { return const_iterator(this, _ptr, _ptr + _size); }
-   /// Iterator
-   iterator end() { return iterator(this, _ptr + _size, _ptr + _size); }
-   /// Iterator
-   const_iterator end() const { return const_iterator(this, _ptr + _size, _ptr + _size); }
-   /// Iterator
-   const_iterator cend() { return const_iterator(this, _ptr + _size, _ptr + _size); }
+   public:
+   /// Constructor
+   template <class... Args>
+   explicit rw_locked(Args&&... args) : _value(std::forward<Args>(args)...) { detail::share_object(_value); }
+   /// Destructor
+   ~rw_locked() { memorysafety::mark_destroyed(&_value); }
 
-   /// Empty?
-   bool empty() const { return !_size; }
-   /// Size
-   size_type size() const { return _size; }
-   /// Size
-   size_type length() const { return _size; }
-   /// Make sure we have enough space
-   void reserve(size_type nc) {
-      memorysafety::mark_modified(this);
-      if (nc > _capacity) {
-         size_type nc2 = _capacity + (_capacity / 8);
-         if (nc2 > nc) nc = nc2;
-         char* np = new char[nc];
-         for (size_type index = 0; index < _size; ++index) np[index] = _ptr[index];
-         delete[] _ptr;
-         _ptr = np;
-         _capacity = nc;
-      }
+   rw_locked(const rw_locked&) = delete;
+   rw_locked& operator=(const rw_locked&) = delete;
+
+   /// Call f with exclusive access to the value
+   template <class F>
+   decltype(auto) apply(F&& f) {
+      std::lock_guard guard(_mutex);
+      memorysafety::invalidate_dependents(&_value);
+      struct Release {
+         T* value;
+         ~Release() { memorysafety::invalidate_dependents(value); }
+      } release{&_value};
+      return std::forward<F>(f)(_value);
+   }
+   /// Call f with shared read access to the value
+   template <class F>
+   decltype(auto) apply_shared(F&& f) const {
+      std::shared_lock guard(_mutex);
+      return std::forward<F>(f)(_value);
    }
+};
+//---------------------------------------------------------------------------
+/// Types whose destructor reports to the runtime. Coroutines register existence dependencies on reference
+/// parameters of these types. Other types can opt in by specializing the trait
+template <class T>
+struct ms_tracked : std::false_type {};
+template <>
+struct ms_tracked<ms_string> : std::true_type {};
+template <>
+struct ms_tracked<ms_string_view> : std::true_type {};
+template <class K, class V, class Hash, class Eq>
+struct ms_tracked<ms_hash_map<K, V, Hash, Eq>> : std::true_type {};
+template <class T>
+struct ms_tracked<ms_deque<T>> : std::true_type {};
+template <>
+struct ms_tracked<ms_arena> : std::true_type {};
+//---------------------------------------------------------------------------
+template <class T = void>
+class ms_task;
+//---------------------------------------------------------------------------
+namespace detail {
+//---------------------------------------------------------------------------
+/// Is a coroutine parameter a reference to a tracked object?
+template <class T>
+inline constexpr bool tracked_reference_v = std::is_reference_v<T> && ms_tracked<std::remove_cvref_t<T>>::value;
+//---------------------------------------------------------------------------
+/// An awaiter that validates the coroutine when it is resumed
+template <class Awaiter>
+struct validating_awaiter {
+   /// The awaiter
+   Awaiter awaiter;
+   /// The object that carries the dependencies of the coroutine, nullptr if nothing is tracked
+   const void* frame;
 
-   // Clear the contents
-   void clear() {
-      memorysafety::mark_modified(this);
-      _size = 0;
+   /// Ready?
+   bool await_ready() { return awaiter.await_ready(); }
+   /// Suspend
+   template <class P>
+   decltype(auto) await_suspend(std::coroutine_handle<P> handle) { return awaiter.await_suspend(handle); }
+   /// Resume. The references that are held across the suspension must still be alive
+   decltype(auto) await_resume() {
+      if (frame) memorysafety::validate(frame);
+      return awaiter.await_resume();
    }
-   /// Erase characters
-   ms_string& erase(size_type index = 0, size_type count = npos) {
-      memorysafety::mark_modified(this);
-      if (index < _size) {
-         if (count < (_size - index)) {
-            for (size_type index = 0, limit = _size - index - count; index != limit; ++index)
-               _ptr[index] = _ptr[index + count];
-            _size -= count;
-         } else {
-            _size = index;
-         }
-      }
-      return *this;
+};
+//---------------------------------------------------------------------------
+/// Get the awaiter of an awaitable
+template <class A>
+decltype(auto) get_awaiter(A&& a) {
+   if constexpr (requires { std::forward<A>(a).operator co_await(); })
+      return std::forward<A>(a).operator co_await();
+   else if constexpr (requires { operator co_await(std::forward<A>(a)); })
+      return operator co_await(std::forward<A>(a));
+   else
+      return std::forward<A>(a);
+}
+//---------------------------------------------------------------------------
+/// The state of a task that does not depend on the parameters
+template <class T>
+struct task_state {
+   /// The result
+   std::optional<T> value;
+   /// The exception, if any
+   std::exception_ptr exception;
+   /// The coroutine that awaits the task
+   std::coroutine_handle<> continuation;
+
+   /// Store the result
+   template <class U>
+   void return_value(U&& v) { value.emplace(std::forward<U>(v)); }
+   /// Take the result
+   T take() {
+      if (exception) std::rethrow_exception(exception);
+      return std::move(*value);
    }
-   /// Erase a character
-   iterator erase(iterator iter) {
-      memorysafety::validate(&iter);
-      memorysafety::assert_spatial((iter.iter >= _ptr) && (iter.iter <= _ptr + _size));
-      size_type pos = iter.iter - _ptr;
-      erase(pos, 1);
-      return iterator(this, _ptr + ((pos < _size) ? pos : _size), _ptr + _size);
+};
+//---------------------------------------------------------------------------
+/// The state of a task without result
+template <>
+struct task_state<void> {
+   /// The exception, if any
+   std::exception_ptr exception;
+   /// The coroutine that awaits the task
+   std::coroutine_handle<> continuation;
+
+   /// Finish
+   void return_void() noexcept {}
+   /// Take the result
+   void take() {
+      if (exception) std::rethrow_exception(exception);
    }
-   /// Erase a range of characters
-   iterator erase(iterator first, iterator last) {
-      memorysafety::validate(&first);
-      memorysafety::validate(&last);
-      memorysafety::assert_spatial((first.iter >= _ptr) && (last.iter >= first.iter) && (last.iter <= _ptr + _size));
-      size_type pos = first.iter - _ptr, count = last.iter - first.iter;
-      erase(pos, count);
-      return iterator(this, _ptr + ((pos < _size) ? pos : _size), _ptr + _size);
+};
+//---------------------------------------------------------------------------
+/// The final awaiter of a task, continues with the awaiting coroutine
+struct task_final_awaiter {
+   /// Never ready
+   bool await_ready() noexcept { return false; }
+   /// Transfer to the continuation
+   template <class P>
+   std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept {
+      auto continuation = handle.promise().continuation;
+      return continuation ? continuation : std::noop_coroutine();
    }
+   /// Never resumed
+   void await_resume() noexcept {}
+};
+//---------------------------------------------------------------------------
+/// The promise of a task. It sees the parameter types of the coroutine and registers an existence dependency on every
+/// tracked reference parameter. Resuming after a suspension point validates the promise, which is a single check
+template <class T, class... Args>
+class task_promise : public task_state<T> {
+   /// Do we track any parameter?
+   static constexpr bool tracking = (tracked_reference_v<Args> || ...);
 
-   /// Append a character
-   void push_back(char c) {
-      // Reserve marks as modified
-      reserve(_size + 1);
+   /// Register a parameter
+   template <class P>
+   void track(const std::remove_reference_t<P>& param) noexcept {
+      if constexpr (tracked_reference_v<P>) memorysafety::add_dependency(this, std::addressof(param));
+   }
 
-      // Check for numeric overflows
-      memorysafety::assert_spatial(_size < _capacity);
+   public:
+   /// Constructor. Receives the parameters of the coroutine
+   explicit task_promise(std::add_lvalue_reference_t<Args>... args) noexcept { (track<Args>(args), ...); }
+   /// Destructor
+   ~task_promise() {
+      if constexpr (tracking) memorysafety::mark_destroyed(this);
+   }
 
-      _ptr[_size++] = c;
+   /// The object that carries the dependencies
+   const void* frame() const noexcept { return tracking ? this : nullptr; }
+   /// Create the task
+   ms_task<T> get_return_object() noexcept;
+   /// Tasks start lazily, the parameters are checked when they start
+   validating_awaiter<std::suspend_always> initial_suspend() noexcept { return {{}, frame()}; }
+   /// Continue with the awaiting coroutine
+   task_final_awaiter final_suspend() noexcept { return {}; }
+   /// Remember an exception
+   void unhandled_exception() noexcept { this->exception = std::current_exception(); }
+   /// Validate the parameters whenever the coroutine resumes
+   template <class A>
+   auto await_transform(A&& a) {
+      using Awaiter = decltype(get_awaiter(std::forward<A>(a)));
+      return validating_awaiter<Awaiter>{get_awaiter(std::forward<A>(a)), frame()};
    }
-   /// Append
-   ms_string& operator+=(char c) {
-      push_back(c);
+};
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+/// A lazily started coroutine. Reference parameters of tracked types must stay alive while the task runs, this is checked
+/// whenever the task resumes. Tasks can be awaited by other tasks, or driven with resume from regular code
+template <class T>
+class ms_task {
+   template <class, class...>
+   friend class detail::task_promise;
+
+   /// The coroutine
+   std::coroutine_handle<> _handle;
+   /// The state
+   detail::task_state<T>* _state;
+
+   /// Constructor
+   ms_task(std::coroutine_handle<> handle, detail::task_state<T>* state) noexcept : _handle(handle), _state(state) {}
+
+   public:
+   /// Move constructor
+   ms_task(ms_task&& o) noexcept : _handle(std::exchange(o._handle, nullptr)), _state(o._state) {}
+   /// Move assignment
+   ms_task& operator=(ms_task&& o) noexcept {
+      if (this != &o) {
+         if (_handle) _handle.destroy();
+         _handle = std::exchange(o._handle, nullptr);
+         _state = o._state;
+      }
       return *this;
    }
-   /// Append
-   ms_string& operator+=(const ms_string& o) {
-      memorysafety::assert_spatial(this != &o);
+   /// Destructor
+   ~ms_task() {
+      if (_handle) _handle.destroy();
+   }
 
-      reserve(_size + o._size);
+   /// Finished?
+   bool done() const noexcept { return (!_handle) || _handle.done(); }
+   /// Start or continue the task
+   void resume() { _handle.resume(); }
+   /// The result of a finished task
+   T result() { return _state->take(); }
 
-      // Check for numeric overflows
-      memorysafety::assert_spatial((_size < _capacity) && (o._size < _capacity));
+   /// Await the task
+   auto operator co_await() noexcept {
+      struct awaiter {
+         std::coroutine_handle<> handle;
+         detail::task_state<T>* state;
 
-      for (size_type index = 0; index != o._size; ++index)
-         _ptr[_size++] = o._ptr[index];
-      return *this;
+         bool await_ready() noexcept { return handle.done(); }
+         std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+            state->continuation = awaiting;
+            return handle;
+         }
+         T await_resume() { return state->take(); }
+      };
+      return awaiter{_handle, _state};
    }
+};
+//---------------------------------------------------------------------------
+template <class T, class... Args>
+ms_task<T> detail::task_promise<T, Args...>::get_return_object() noexcept
+// Create the task
+{
+   return ms_task<T>(std::coroutine_handle<task_promise>::from_promise(*this), this);
+}
+//---------------------------------------------------------------------------
+template <class Signature>
+class ms_function;
+//---------------------------------------------------------------------------
+namespace detail {
+//---------------------------------------------------------------------------
+/// The operations of a callable that is stored in an ms_function
+template <class R, class... Args>
+struct function_ops {
+   /// Call the callable
+   R (*invoke)(void* storage, Args&&... args);
+   /// Move the callable to new storage and destroy the old one
+   void (*relocate)(void* target, void* source) noexcept;
+   /// Destroy the callable
+   void (*destroy)(void* storage) noexcept;
+};
+//---------------------------------------------------------------------------
+/// Callables that fit into the buffer are stored inline, all others on the heap
+template <class F, std::size_t size, std::size_t alignment>
+inline constexpr bool store_inline_v = (sizeof(F) <= size) && (alignof(F) <= alignment) && std::is_nothrow_move_constructible_v<F>;
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+/// A move-only function wrapper. Small callables are stored inline without heap allocation. Like ref_wrapper, the
+/// function can depend on the objects that its callable references, which are validated once per call instead of at
+/// every access to a captured reference. Moving the function moves the dependencies
+template <class R, class... Args>
+class ms_function<R(Args...)> {
+   /// The size of the inline buffer
+   static constexpr std::size_t bufferSize = 3 * sizeof(void*);
+   /// The alignment of the inline buffer
+   static constexpr std::size_t bufferAlignment = alignof(void*);
+   /// The operations
+   using ops = detail::function_ops<R, Args...>;
 
-   /// Change the string size
-   void resize(size_type ns, char c = '\0') {
-      memorysafety::mark_modified(this);
+   /// The operations of a callable type
+   template <class F>
+   static constexpr ops opsFor = detail::store_inline_v<F, bufferSize, bufferAlignment> ?
+      ops{[](void* storage, Args&&... args) -> R { return std::invoke(*static_cast<F*>(storage), std::forward<Args>(args)...); },
+          [](void* target, void* source) noexcept {
+             new (target) F(std::move(*static_cast<F*>(source)));
+             static_cast<F*>(source)->~F();
+          },
+          [](void* storage) noexcept { static_cast<F*>(storage)->~F(); }} :
+      ops{[](void* storage, Args&&... args) -> R { return std::invoke(**static_cast<F**>(storage), std::forward<Args>(args)...); },
+          [](void* target, void* source) noexcept { *static_cast<F**>(target) = *static_cast<F**>(source); },
+          [](void* storage) noexcept { delete *static_cast<F**>(storage); }};
 
-      if (ns < _size) {
-         _size = ns;
-      } else if (ns > _size) {
-         reserve(ns);
-         memorysafety::assert_spatial(ns <= _capacity);
-         while (_size < ns) _ptr[_size++] = c;
+   /// The storage of the callable
+   alignas(bufferAlignment) unsigned char _storage[bufferSize];
+   /// The operations, nullptr if empty
+   const ops* _ops = nullptr;
+   /// Do we track referenced objects?
+   bool _tracking = false;
+
+   /// Take the callable and the dependencies of another function
+   void take(ms_function& o) noexcept {
+      if (o._ops) {
+         o._ops->relocate(_storage, o._storage);
+         _ops = std::exchange(o._ops, nullptr);
+      }
+      if (o._tracking) {
+         memorysafety::propagate_dependencies(this, &o);
+         memorysafety::mark_destroyed(&o);
+         _tracking = std::exchange(o._tracking, false);
       }
    }
 
-   /// Swap the content
-   void swap(ms_string& o) noexcept {
+   public:
+   /// Constructor
+   ms_function() noexcept = default;
+   /// Constructor
+   ms_function(std::nullptr_t) noexcept {}
+   /// Constructor. The function depends on the existence of the referenced objects
+   template <class F, class... Refs>
+      requires(!std::is_same_v<std::remove_cvref_t<F>, ms_function> && std::is_invocable_r_v<R, std::decay_t<F>&, Args...>)
+   ms_function(F&& f, Refs&... refs) {
+      using Callable = std::decay_t<F>;
+      if constexpr (detail::store_inline_v<Callable, bufferSize, bufferAlignment>)
+         new (_storage) Callable(std::forward<F>(f));
+      else
+         *reinterpret_cast<Callable**>(_storage) = new Callable(std::forward<F>(f));
+      _ops = &opsFor<Callable>;
+      if constexpr (sizeof...(Refs) > 0) {
+         _tracking = true;
+         (memorysafety::add_dependency(this, std::addressof(refs)), ...);
+      }
+   }
+   /// Move constructor
+   ms_function(ms_function&& o) noexcept { take(o); }
+   /// Destructor
+   ~ms_function() { reset(); }
+
+   /// Move assignment
+   ms_function& operator=(ms_function&& o) noexcept {
       if (this != &o) {
-         memorysafety::mark_modified(this);
-         memorysafety::mark_modified(&o);
+         reset();
+         take(o);
+      }
+      return *this;
+   }
+   /// Clear the function
+   ms_function& operator=(std::nullptr_t) noexcept {
+      reset();
+      return *this;
+   }
 
-         {
-            auto tmp = _ptr;
-            _ptr = o._ptr;
-            o._ptr = tmp;
+   /// Clear the function and drop the dependencies
+   void reset() noexcept {
+      if (_ops) std::exchange(_ops, nullptr)->destroy(_storage);
+      if (_tracking) {
+         memorysafety::mark_destroyed(this);
+         _tracking = false;
+      }
+   }
+   /// Is there a callable?
+   explicit operator bool() const noexcept { return _ops; }
+   /// Call the function. The referenced objects are validated once
+   R operator()(Args... args) {
+      if (!_ops) throw std::bad_function_call();
+      if (_tracking) memorysafety::validate(this);
+      return _ops->invoke(_storage, std::forward<Args>(args)...);
+   }
+};
+//---------------------------------------------------------------------------
+/// A work item for a thread pool that depends on the existence of the objects it references. The task wraps an
+/// ms_function that registers the dependencies when the task is created and validates them once when it starts. The
+/// task runs on another thread, so the referenced objects are shared with all threads first, like the value of locked,
+/// which also clears their owner tags. Accesses to them must be synchronized by the caller. The dependencies are remote
+/// dependencies of the function, which is then moved into the shared domain, so that every worker can validate and
+/// destroy it. Tasks without referenced objects do not call the runtime at all
+class ms_checked_task {
+   /// The function. Lives on the heap, so its dependencies stay in place while the task is queued and moved around
+   std::unique_ptr<ms_function<void()>> _function;
+
+   /// Share the referenced objects and create the function
+   template <class F, class... Refs>
+   static std::unique_ptr<ms_function<void()>> make(F&& f, Refs&... refs) {
+      (detail::share_object(refs), ...);
+      return std::make_unique<ms_function<void()>>(std::forward<F>(f), refs...);
+   }
+
+   public:
+   /// Constructor
+   ms_checked_task() noexcept = default;
+   /// Constructor. The referenced objects must stay alive until the task starts
+   template <class F, class... Refs>
+      requires(!std::is_same_v<std::remove_cvref_t<F>, ms_checked_task> && std::is_invocable_v<std::decay_t<F>&>)
+   explicit ms_checked_task(F&& f, Refs&... refs) : _function(make(std::forward<F>(f), refs...)) {
+      if constexpr (sizeof...(Refs) > 0) memorysafety::transfer(_function.get(), 0);
+   }
+
+   /// Is there a task?
+   explicit operator bool() const noexcept { return static_cast<bool>(_function); }
+   /// Run the task. A task runs at most once
+   void operator()() {
+      if (!_function) throw std::bad_function_call();
+      auto function = std::move(_function);
+      (*function)();
+   }
+};
+//---------------------------------------------------------------------------
+/// A small work-stealing thread pool. Every worker owns a queue, tasks submitted by a worker go to its own queue and are
+/// taken newest first, idle workers steal the oldest tasks of the others. Tasks submitted by other threads are
+/// distributed round robin. Tasks must not throw
+class ms_executor {
+   /// The queue of a worker
+   struct alignas(64) queue {
+      /// The mutex
+      adaptive_mutex mutex;
+      /// The tasks
+      std::deque<ms_checked_task> tasks;
+   };
+   /// The worker that runs on a thread
+   struct worker {
+      /// The executor
+      ms_executor* executor;
+      /// The queue of the worker
+      unsigned index;
+   };
+
+   /// The number of workers
+   unsigned _count;
+   /// The queues
+   std::unique_ptr<queue[]> _queues;
+   /// The worker threads
+   std::vector<std::thread> _threads;
+   /// The number of queued tasks. Idle workers wait until it changes
+   std::atomic<unsigned> _queued{0};
+   /// The number of workers that wait for tasks
+   std::atomic<unsigned> _idle{0};
+   /// The number of tasks that have not finished yet
+   std::atomic<unsigned> _unfinished{0};
+   /// The next queue for submissions from other threads
+   std::atomic<unsigned> _next{0};
+   /// Shut down?
+   std::atomic<bool> _stop{false};
+   /// The worker running on this thread, if any
+   static inline thread_local worker current;
+   /// The number of times an idle worker yields before parking
+   static constexpr unsigned spinCount = 16;
+
+   /// Find a task, looking at the own queue first
+   bool find(unsigned self, ms_checked_task& task) {
+      {
+         auto& q = _queues[self];
+         std::lock_guard guard(q.mutex);
+         if (!q.tasks.empty()) {
+            task = std::move(q.tasks.back());
+            q.tasks.pop_back();
+            return true;
          }
-         {
-            auto tmp = _size;
-            _size = o._size;
-            o._size = tmp;
+      }
+      for (unsigned step = 1; step < _count; ++step) {
+         auto& q = _queues[(self + step) % _count];
+         std::lock_guard guard(q.mutex);
+         if (!q.tasks.empty()) {
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+            return true;
          }
-         {
-            auto tmp = _capacity;
-            _capacity = o._capacity;
-            o._capacity = tmp;
+      }
+      return false;
+   }
+   /// Wait briefly for new tasks. Parking and waking a worker for every task costs more than the tasks themselves
+   bool poll() const noexcept {
+      for (unsigned spin = 0; spin != spinCount; ++spin) {
+         std::this_thread::yield();
+         if (_queued.load(std::memory_order_relaxed)) return true;
+      }
+      return false;
+   }
+   /// The main loop of a worker
+   void work(unsigned self) noexcept {
+      current = {this, self};
+      ms_checked_task task;
+      while (true) {
+         if (find(self, task)) {
+            _queued.fetch_sub(1, std::memory_order_relaxed);
+            task();
+            if (_unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1) _unfinished.notify_all();
+            continue;
          }
+         if (_stop.load(std::memory_order_acquire)) break;
+         if (poll()) continue;
+         // Announce that we wait before checking the queue count, submitters only wake idle workers
+         _idle.fetch_add(1);
+         _queued.wait(0);
+         _idle.fetch_sub(1, std::memory_order_relaxed);
       }
+      current = {};
    }
+
+   public:
+   /// Constructor
+   explicit ms_executor(unsigned threads = std::thread::hardware_concurrency()) : _count(threads ? threads : 1), _queues(std::make_unique<queue[]>(_count)) {
+      _threads.reserve(_count);
+      for (unsigned index = 0; index != _count; ++index) _threads.emplace_back([this, index] { work(index); });
+   }
+   /// Destructor. Runs the remaining tasks
+   ~ms_executor() {
+      _stop.store(true, std::memory_order_release);
+      _queued.fetch_add(1, std::memory_order_release);
+      _queued.notify_all();
+      for (auto& t : _threads) t.join();
+   }
+
+   ms_executor(const ms_executor&) = delete;
+   ms_executor& operator=(const ms_executor&) = delete;
+
+   /// Submit a task
+   void submit(ms_checked_task task) {
+      // Workers must not throw, so empty tasks are dropped here
+      if (!task) return;
+      unsigned index = (current.executor == this) ? current.index : (_next.fetch_add(1, std::memory_order_relaxed) % _count);
+      _unfinished.fetch_add(1, std::memory_order_relaxed);
+      {
+         auto& q = _queues[index];
+         std::lock_guard guard(q.mutex);
+         q.tasks.push_back(std::move(task));
+      }
+      _queued.fetch_add(1);
+      if (_idle.load()) _queued.notify_one();
+   }
+   /// Submit a function that references the given objects. The references are checked when the task starts
+   template <class F, class... Refs>
+      requires std::is_invocable_v<std::decay_t<F>&>
+   void submit(F&& f, Refs&... refs) {
+      submit(ms_checked_task(std::forward<F>(f), refs...));
+   }
+   /// Wait until all submitted tasks have finished. Must not be called by a worker
+   void wait() noexcept {
+      for (auto unfinished = _unfinished.load(std::memory_order_acquire); unfinished; unfinished = _unfinished.load(std::memory_order_acquire))
+         _unfinished.wait(unfinished, std::memory_order_acquire);
+   }
+   /// The number of worker threads
+   unsigned size() const noexcept { return _count; }
+};
+//---------------------------------------------------------------------------
+namespace std {
+//---------------------------------------------------------------------------
+/// The promise of a task sees the parameter types
+template <class T, class... Args>
+struct coroutine_traits<ms_task<T>, Args...> {
+   using promise_type = detail::task_promise<T, Args...>;
 };
 //---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
 #endif